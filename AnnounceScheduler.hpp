@@ -0,0 +1,148 @@
+#ifndef V2V_PROTOCOL_DEMO_ANNOUNCESCHEDULER_HPP
+#define V2V_PROTOCOL_DEMO_ANNOUNCESCHEDULER_HPP
+
+#include <cstdint>
+#include <random>
+
+
+/**
+ * Intervals of the AnnouncePresence policy, in milliseconds.
+ */
+struct AnnouncePolicy
+{
+    uint32_t minInterval;       // interval after a change in the neighbourhood
+    uint32_t maxInterval;       // interval the quiet state backs off to
+    uint32_t redundancy;        // announcements of the own group heard that suppress one, 0 never suppresses
+};
+
+
+/**
+ * Counters since the last reset.
+ */
+struct AnnounceCounters
+{
+    uint64_t sent;              // announcements that were due and went out
+    uint64_t suppressed;        // ... that were due but enough others were heard
+    uint64_t resets;            // changes that brought the interval back to minInterval
+};
+
+
+/**
+ * Decides when a car sends AnnouncePresence, after Trickle (RFC 6206).
+ *
+ * Time is divided into intervals. Each interval has one announcement at a
+ * random point in its second half, which is left out if `redundancy` cars
+ * of the same group were heard announcing in the interval so far. Every
+ * interval is twice as long as the previous one, up to maxInterval, so a
+ * neighbourhood that does not change costs fewer and fewer broadcasts.
+ * A change (a car that was not known, a follower or leader that left)
+ * starts over at minInterval so newcomers find the car quickly.
+ *
+ * Not thread-safe, the caller serializes access.
+ */
+class AnnounceScheduler {
+public:
+    AnnounceScheduler(const AnnouncePolicy &config, uint32_t seed)
+        : policy(config), random(seed), totals()
+    {
+        if (policy.minInterval < 1) {policy.minInterval = 1;}
+        if (policy.maxInterval < policy.minInterval) {policy.maxInterval = policy.minInterval;}
+        start(0);
+    }
+
+    /**
+     * Starts the first interval, at minInterval.
+     */
+    void start(uint64_t nowMicros) noexcept
+    {
+        intervalLength = policy.minInterval;
+        begin(nowMicros);
+    }
+
+    /**
+     * Starts over at minInterval, unless the current interval already is that short.
+     *
+     * @return true if the interval changed, the caller should re-arm its timer
+     */
+    bool reset(uint64_t nowMicros) noexcept
+    {
+        if (intervalLength == policy.minInterval) {return false;}
+        intervalLength = policy.minInterval;
+        totals.resets++;
+        begin(nowMicros);
+        return true;
+    }
+
+    /**
+     * Counts an announcement of the own group by another car.
+     */
+    void heard() noexcept
+    {
+        heardCount++;
+    }
+
+    /**
+     * Advances to nowMicros.
+     *
+     * @return true if an announcement is due now
+     */
+    bool fire(uint64_t nowMicros) noexcept
+    {
+        bool due = false;
+        if (not fired && nowMicros >= intervalStart + dueAt)
+        {
+            fired = true;
+            due = 0 == policy.redundancy || heardCount < policy.redundancy;
+            if (due) {totals.sent++;}
+            else {totals.suppressed++;}
+        }
+        if (nowMicros >= intervalStart + static_cast<uint64_t>(intervalLength) * 1000)
+        {
+            intervalLength = intervalLength > policy.maxInterval / 2 ? policy.maxInterval
+                                                                     : intervalLength * 2;
+            begin(nowMicros);
+        }
+        return due;
+    }
+
+    /**
+     * @return milliseconds until fire() has something to do
+     */
+    uint32_t wait(uint64_t nowMicros) const noexcept
+    {
+        const uint64_t next = intervalStart
+            + (fired ? static_cast<uint64_t>(intervalLength) * 1000 : dueAt);
+        return next > nowMicros ? static_cast<uint32_t>((next - nowMicros + 999) / 1000) : 0;
+    }
+
+    AnnounceCounters counters(bool reset) noexcept
+    {
+        const AnnounceCounters current = totals;
+        if (reset) {totals = AnnounceCounters();}
+        return current;
+    }
+
+    uint32_t interval() const noexcept { return intervalLength; }
+
+private:
+    AnnouncePolicy policy;
+    std::minstd_rand random;
+    uint32_t intervalLength;    // milliseconds
+    uint64_t intervalStart;     // monotonic microseconds
+    uint64_t dueAt;             // microseconds into the interval the announcement is due
+    uint32_t heardCount;
+    bool fired;
+    AnnounceCounters totals;
+
+    void begin(uint64_t nowMicros) noexcept
+    {
+        const uint64_t length = static_cast<uint64_t>(intervalLength) * 1000;
+        std::uniform_int_distribution<uint64_t> point(length / 2, length - 1);
+        intervalStart = nowMicros;
+        dueAt = point(random);
+        heardCount = 0;
+        fired = false;
+    }
+};
+
+#endif //V2V_PROTOCOL_DEMO_ANNOUNCESCHEDULER_HPP
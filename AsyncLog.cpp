@@ -0,0 +1,200 @@
+// Vera requires this "Copyright" notice
+
+#include "AsyncLog.hpp"
+
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <chrono>
+#include <climits>
+#include <iomanip>
+#include <iostream>
+
+/**
+ * Sleeps until the word is bumped, returns at once if it is no longer seen.
+ */
+static void futexWait(std::atomic<uint32_t> &word, uint32_t seen) noexcept
+{
+    ::syscall(SYS_futex, &word, FUTEX_WAIT_PRIVATE, seen, nullptr, nullptr, 0);
+}
+
+static void futexWake(std::atomic<uint32_t> &word, int waiters) noexcept
+{
+    ::syscall(SYS_futex, &word, FUTEX_WAKE_PRIVATE, waiters, nullptr, nullptr, 0);
+}
+
+/**
+ * @return the process-wide logger, its drain thread is started on first use
+ */
+AsyncLog &AsyncLog::instance()
+{
+    static AsyncLog log;
+    return log;
+}
+
+AsyncLog::AsyncLog()
+    : enqueuePos(0), dequeuePos(0), droppedRecords(0), threshold(0), running(true), sleeping(0),
+      wake(0), flushing(0), drained(0)
+{
+    for (size_t i = 0; i < CAPACITY; i++)
+    {
+        cells[i].sequence.store(i, std::memory_order_relaxed);
+    }
+    drainThread = std::thread(&AsyncLog::drain, this);
+}
+
+AsyncLog::~AsyncLog()
+{
+    running.store(false, std::memory_order_release);
+    notify();
+    if (drainThread.joinable()) {drainThread.join();}
+}
+
+void AsyncLog::flush()
+{
+    const size_t target = enqueuePos.load(std::memory_order_acquire);
+    flushing.fetch_add(1);
+    // Pairs with the fence of notifyFlushed(): either it sees this flushing or this sees the batch
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    for (;;)
+    {
+        const uint32_t seen = drained.load(std::memory_order_acquire);
+        if (dequeuePos.load(std::memory_order_acquire) >= target
+            || not running.load(std::memory_order_acquire))
+        {
+            break;
+        }
+        futexWait(drained, seen);
+    }
+    flushing.fetch_sub(1);
+}
+
+/**
+ * Drain thread: prints records in batches and sleeps while the ring is empty.
+ * Remaining records are printed before the thread ends.
+ */
+void AsyncLog::drain()
+{
+    while (running.load(std::memory_order_acquire))
+    {
+        bool printed = false;
+        while (drainOnce()) {printed = true;}
+        if (printed)
+        {
+            std::cout.flush();
+            notifyFlushed();
+            continue;
+        }
+
+        const uint32_t seen = wake.load(std::memory_order_acquire);
+        sleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (not readable() && running.load(std::memory_order_acquire))
+        {
+            // Returns at once if a writer bumped wake since it was read
+            futexWait(wake, seen);
+        }
+        sleeping.store(0, std::memory_order_relaxed);
+    }
+    while (drainOnce()) {}
+    const uint64_t lost = dropped();
+    if (lost > 0)
+    {
+        std::cout << "[log] " << lost << " records dropped\n";
+    }
+    std::cout.flush();
+    // Nobody drains any more, so no flush() may keep waiting
+    drained.fetch_add(1, std::memory_order_release);
+    futexWake(drained, INT_MAX);
+}
+
+bool AsyncLog::drainOnce()
+{
+    const size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    Cell &cell = cells[pos & (CAPACITY - 1)];
+    if (cell.sequence.load(std::memory_order_acquire) != pos + 1) {return false;}
+
+    print(cell.record);
+    cell.sequence.store(pos + CAPACITY, std::memory_order_release);
+    dequeuePos.store(pos + 1, std::memory_order_release);
+    return true;
+}
+
+/**
+ * @return true if the next record was published by its writer
+ */
+bool AsyncLog::readable() const noexcept
+{
+    const size_t pos = dequeuePos.load(std::memory_order_relaxed);
+    return cells[pos & (CAPACITY - 1)].sequence.load(std::memory_order_acquire) == pos + 1;
+}
+
+/**
+ * Wakes the drain thread.
+ */
+void AsyncLog::notify() noexcept
+{
+    wake.fetch_add(1, std::memory_order_release);
+    futexWake(wake, 1);
+}
+
+/**
+ * Wakes the threads in flush() after a batch, if there are any.
+ */
+void AsyncLog::notifyFlushed() noexcept
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (0 == flushing.load(std::memory_order_relaxed)) {return;}
+    drained.fetch_add(1, std::memory_order_release);
+    futexWake(drained, INT_MAX);
+}
+
+/**
+ * Formats a record, replacing each "{}" in the format with the next argument.
+ */
+void AsyncLog::print(const LogRecord &record)
+{
+    static const char *const LEVELS[] = {"", "", "warning: ", "error: "};
+
+    std::cout << '[' << std::fixed << std::setprecision(6)
+              << static_cast<double>(record.time) / 1e6 << "] ";
+    std::cout.unsetf(std::ios::floatfield);
+    std::cout << std::setprecision(6);
+    if (record.level < 4) {std::cout << LEVELS[record.level];}
+
+    uint8_t arg = 0;
+    for (const char *c = record.format; *c != '\0'; c++)
+    {
+        if ('{' == c[0] && '}' == c[1] && arg < record.argc)
+        {
+            switch (record.types[arg])
+            {
+                case LogRecord::INT: std::cout << record.values[arg].i; break;
+                case LogRecord::UINT: std::cout << record.values[arg].u; break;
+                case LogRecord::REAL: std::cout << record.values[arg].d; break;
+                case LogRecord::TEXT:
+                {
+                    std::cout.write(record.text + record.values[arg].text[0],
+                        record.values[arg].text[1]);
+                } break;
+            }
+            arg++;
+            c++;
+        }
+        else
+        {
+            std::cout.put(*c);
+        }
+    }
+    std::cout.put('\n');
+}
+
+/**
+ * @return monotonic microseconds, taken on the writing thread
+ */
+uint64_t AsyncLog::now() noexcept
+{
+    using namespace std::chrono;
+    return static_cast<uint64_t>(
+        duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+}
@@ -0,0 +1,258 @@
+#ifndef V2V_PROTOCOL_DEMO_ASYNCLOG_HPP
+#define V2V_PROTOCOL_DEMO_ASYNCLOG_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+
+
+/********************************************************/
+/** Log levels ******************************************/
+/********************************************************/
+#define V2V_LOG_DEBUG   0
+#define V2V_LOG_INFO    1
+#define V2V_LOG_WARN    2
+#define V2V_LOG_ERROR   3
+#define V2V_LOG_OFF     4
+
+// Lowest level compiled in, statements below it generate no code at all
+#ifndef V2V_LOG_LEVEL
+#define V2V_LOG_LEVEL V2V_LOG_INFO
+#endif
+
+#if V2V_LOG_LEVEL <= V2V_LOG_DEBUG
+#define LOG_DEBUG(...) AsyncLog::instance().write(V2V_LOG_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) do {} while (0)
+#endif
+
+#if V2V_LOG_LEVEL <= V2V_LOG_INFO
+#define LOG_INFO(...) AsyncLog::instance().write(V2V_LOG_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) do {} while (0)
+#endif
+
+#if V2V_LOG_LEVEL <= V2V_LOG_WARN
+#define LOG_WARN(...) AsyncLog::instance().write(V2V_LOG_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) do {} while (0)
+#endif
+
+#if V2V_LOG_LEVEL <= V2V_LOG_ERROR
+#define LOG_ERROR(...) AsyncLog::instance().write(V2V_LOG_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) do {} while (0)
+#endif
+
+
+/**
+ * Binary log record. The format string is a literal and is referenced, not
+ * copied. Numbers are stored raw and text arguments are copied into a small
+ * inline pool, so nothing is formatted or allocated by the logging thread.
+ */
+struct LogRecord
+{
+    enum Type : uint8_t { INT, UINT, REAL, TEXT };
+
+    static const size_t MAX_ARGS = 6;
+    static const size_t TEXT_SIZE = 64;
+
+    uint64_t time;
+    const char *format;
+    uint8_t level;
+    uint8_t argc;
+    uint8_t textUsed;
+    Type types[MAX_ARGS];
+    union
+    {
+        int64_t i;
+        uint64_t u;
+        double d;
+        uint8_t text[2];        // offset and length into the text pool
+    } values[MAX_ARGS];
+    char text[TEXT_SIZE];
+};
+
+
+/**
+ * Asynchronous logger.
+ *
+ * Any thread may write; records go into a bounded lock-free MPSC ring and a
+ * background thread formats and prints them. Writers never block: when the
+ * ring is full the record is dropped and counted.
+ *
+ * The drain thread sleeps on a futex while the ring is empty. As in
+ * SharedRing, a writer only makes the wake-up call when the drain thread said
+ * it is going to sleep, and flush() waits on a futex the drain thread bumps
+ * after each batch while somebody flushes.
+ */
+class AsyncLog {
+public:
+    static AsyncLog &instance();
+    ~AsyncLog();
+    AsyncLog(const AsyncLog &) = delete;
+    AsyncLog &operator=(const AsyncLog &) = delete;
+
+    /**
+     * Queues a record. Placeholders "{}" in the format are replaced by the
+     * arguments in order when the record is printed.
+     */
+    template <class... Args>
+    void write(uint8_t level, const char *format, const Args &... args) noexcept
+    {
+        static_assert(sizeof...(Args) <= LogRecord::MAX_ARGS, "Too many log arguments");
+        if (level < threshold.load(std::memory_order_relaxed)) {return;}
+
+        size_t pos = enqueuePos.load(std::memory_order_relaxed);
+        Cell *cell;
+        for (;;)
+        {
+            cell = &cells[pos & (CAPACITY - 1)];
+            const size_t seq = cell->sequence.load(std::memory_order_acquire);
+            const intptr_t dif = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (0 == dif)
+            {
+                if (enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                {
+                    break;
+                }
+            }
+            else if (dif < 0)
+            {
+                droppedRecords.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            else
+            {
+                pos = enqueuePos.load(std::memory_order_relaxed);
+            }
+        }
+
+        LogRecord &record = cell->record;
+        record.time = now();
+        record.format = format;
+        record.level = level;
+        record.argc = 0;
+        record.textUsed = 0;
+        capture(record, args...);
+        cell->sequence.store(pos + 1, std::memory_order_release);
+
+        // Pairs with the fence of drain(): either it sees the record or this sees it sleeping
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (0 != sleeping.load(std::memory_order_relaxed)) {notify();}
+    }
+
+    /**
+     * Blocks until every record queued so far has been printed.
+     */
+    void flush();
+
+    /**
+     * Runtime filter on top of V2V_LOG_LEVEL, records below it are discarded.
+     */
+    void level(uint8_t minimum) noexcept
+    {
+        threshold.store(minimum, std::memory_order_relaxed);
+    }
+
+    uint64_t dropped() const noexcept
+    {
+        return droppedRecords.load(std::memory_order_relaxed);
+    }
+
+private:
+    static const size_t CAPACITY = 1024;    // power of two
+
+    struct Cell
+    {
+        std::atomic<size_t> sequence;
+        LogRecord record;
+    };
+
+    Cell cells[CAPACITY];
+    alignas(64) std::atomic<size_t> enqueuePos;
+    alignas(64) std::atomic<size_t> dequeuePos;
+    std::atomic<uint64_t> droppedRecords;
+    std::atomic<uint8_t> threshold;
+    std::atomic<bool> running;
+    std::atomic<uint32_t> sleeping;     // the drain thread waits on wake
+    std::atomic<uint32_t> wake;         // futex word, bumped to wake the drain thread
+    std::atomic<uint32_t> flushing;     // threads waiting in flush()
+    std::atomic<uint32_t> drained;      // futex word, bumped after a batch while flushing
+    std::thread drainThread;
+
+    AsyncLog();
+    void drain();
+    bool drainOnce();
+    bool readable() const noexcept;
+    void notify() noexcept;
+    void notifyFlushed() noexcept;
+    static void print(const LogRecord &record);
+    static uint64_t now() noexcept;
+
+    static void capture(LogRecord &) noexcept {}
+
+    template <class T, class... Rest>
+    static void capture(LogRecord &record, const T &value, const Rest &... rest) noexcept
+    {
+        captureOne(record, value);
+        record.argc++;
+        capture(record, rest...);
+    }
+
+    template <class T>
+    static typename std::enable_if<std::is_floating_point<T>::value>::type
+    captureOne(LogRecord &record, const T &value) noexcept
+    {
+        record.types[record.argc] = LogRecord::REAL;
+        record.values[record.argc].d = static_cast<double>(value);
+    }
+
+    template <class T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_signed<T>::value>::type
+    captureOne(LogRecord &record, const T &value) noexcept
+    {
+        record.types[record.argc] = LogRecord::INT;
+        record.values[record.argc].i = static_cast<int64_t>(value);
+    }
+
+    template <class T>
+    static typename std::enable_if<std::is_integral<T>::value && std::is_unsigned<T>::value>::type
+    captureOne(LogRecord &record, const T &value) noexcept
+    {
+        record.types[record.argc] = LogRecord::UINT;
+        record.values[record.argc].u = static_cast<uint64_t>(value);
+    }
+
+    static void captureOne(LogRecord &record, const std::string &value) noexcept
+    {
+        captureText(record, value.data(), value.length());
+    }
+
+    static void captureOne(LogRecord &record, std::string_view value) noexcept
+    {
+        captureText(record, value.data(), value.length());
+    }
+
+    static void captureOne(LogRecord &record, const char *value) noexcept
+    {
+        captureText(record, value, std::strlen(value));
+    }
+
+    static void captureText(LogRecord &record, const char *value, size_t length) noexcept
+    {
+        const size_t room = LogRecord::TEXT_SIZE - record.textUsed;
+        if (length > room) {length = room;}
+        std::memcpy(record.text + record.textUsed, value, length);
+        record.types[record.argc] = LogRecord::TEXT;
+        record.values[record.argc].text[0] = record.textUsed;
+        record.values[record.argc].text[1] = static_cast<uint8_t>(length);
+        record.textUsed = static_cast<uint8_t>(record.textUsed + length);
+    }
+};
+
+#endif //V2V_PROTOCOL_DEMO_ASYNCLOG_HPP
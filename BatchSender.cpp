@@ -0,0 +1,116 @@
+// Vera requires this "Copyright" notice
+
+#include "BatchSender.hpp"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+BatchSender::BatchSender() : calls(0), datagrams(0), failed(0)
+{
+    socketFd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+}
+
+BatchSender::~BatchSender()
+{
+    if (socketFd >= 0) {::close(socketFd);}
+}
+
+/**
+ * Converts a dotted IPv4 address and port into a socket address.
+ *
+ * @param ip - IPv4 address of the peer
+ * @param port - UDP port of the peer
+ * @param address - resolved address
+ * @return false if the IP could not be parsed
+ */
+bool BatchSender::resolve(const std::string &ip, uint16_t port, sockaddr_in &address)
+{
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    return 1 == ::inet_pton(AF_INET, ip.c_str(), &address.sin_addr);
+}
+
+/**
+ * Sends from a fixed local address instead of the one the route picks,
+ * needed for cars sharing a host on different loopback addresses.
+ *
+ * @param ip - local IPv4 address to send from
+ * @return false if the address could not be bound
+ */
+bool BatchSender::bind(const std::string &ip)
+{
+    sockaddr_in address;
+    if (socketFd < 0 || not resolve(ip, 0, address)) {return false;}
+    return 0 == ::bind(socketFd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+}
+
+/**
+ * Sends the payload to every target, prefixed with the target's header.
+ *
+ * @param targets - destinations and their frame headers
+ * @param count - number of targets
+ * @param payload - encoded message shared by all datagrams
+ * @param length - payload length
+ * @return number of datagrams handed to the kernel
+ */
+size_t BatchSender::send(const BatchTarget *targets, size_t count, const char *payload,
+    size_t length)
+{
+    if (socketFd < 0 || 0 == count) {return 0;}
+
+    size_t sent = 0;
+    size_t next = 0;
+    while (next < count)
+    {
+        const size_t batch = (count - next) < MAX_BATCH ? (count - next) : MAX_BATCH;
+        struct mmsghdr messages[MAX_BATCH];
+        struct iovec parts[MAX_BATCH][2];
+        std::memset(messages, 0, sizeof(messages[0]) * batch);
+
+        for (size_t i = 0; i < batch; i++)
+        {
+            const BatchTarget &target = targets[next + i];
+            parts[i][0].iov_base = const_cast<char *>(target.header);
+            parts[i][0].iov_len = target.headerLength;
+            parts[i][1].iov_base = const_cast<char *>(payload);
+            parts[i][1].iov_len = length;
+            messages[i].msg_hdr.msg_name = const_cast<sockaddr_in *>(&target.address);
+            messages[i].msg_hdr.msg_namelen = sizeof(target.address);
+            messages[i].msg_hdr.msg_iov = parts[i];
+            messages[i].msg_hdr.msg_iovlen = 2;
+        }
+
+        int result;
+        do
+        {
+            result = ::sendmmsg(socketFd, messages, static_cast<unsigned int>(batch), 0);
+        } while (result < 0 && EINTR == errno);
+
+        // A short count means the datagram after the last sent one failed, skip it
+        const size_t accepted = result > 0 ? static_cast<size_t>(result) : 0;
+        sent += accepted;
+        next += accepted < batch ? accepted + 1 : accepted;
+    }
+    calls.fetch_add(1, std::memory_order_relaxed);
+    datagrams.fetch_add(sent, std::memory_order_relaxed);
+    failed.fetch_add(count - sent, std::memory_order_relaxed);
+    return sent;
+}
+
+/**
+ * @return what went through this sender, it only ever opens one socket
+ */
+SendCounters BatchSender::counters() const
+{
+    SendCounters current;
+    current.sockets = socketFd >= 0 ? 1 : 0;
+    current.calls = calls.load(std::memory_order_relaxed);
+    current.datagrams = datagrams.load(std::memory_order_relaxed);
+    current.failed = failed.load(std::memory_order_relaxed);
+    return current;
+}
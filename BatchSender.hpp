@@ -0,0 +1,65 @@
+#ifndef V2V_PROTOCOL_DEMO_BATCHSENDER_HPP
+#define V2V_PROTOCOL_DEMO_BATCHSENDER_HPP
+
+#include <netinet/in.h>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+
+/**
+ * One destination of a batched send. Every destination gets its own frame
+ * header in front of the shared payload.
+ */
+struct BatchTarget
+{
+    sockaddr_in address;
+    const char *header;
+    size_t headerLength;
+};
+
+
+/**
+ * What a car sent, since it was created.
+ */
+struct SendCounters
+{
+    uint64_t sockets;           // sockets opened for sending
+    uint64_t calls;             // sends with at least one destination
+    uint64_t datagrams;         // datagrams handed to the network
+    uint64_t failed;            // datagrams the network refused
+};
+
+
+/**
+ * UDP socket that sends one payload to many peers with a single sendmmsg(2)
+ * call. The payload is never copied, each datagram is gathered from its
+ * header and the shared payload buffer.
+ */
+class BatchSender {
+public:
+    BatchSender();
+    ~BatchSender();
+    BatchSender(const BatchSender &) = delete;
+    BatchSender &operator=(const BatchSender &) = delete;
+
+    static bool resolve(const std::string &ip, uint16_t port, sockaddr_in &address);
+
+    bool bind(const std::string &ip);
+
+    size_t send(const BatchTarget *targets, size_t count, const char *payload, size_t length);
+    SendCounters counters() const;
+
+private:
+    static const size_t MAX_BATCH = 64;
+
+    int socketFd;
+
+    // Sends come from several threads
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> datagrams;
+    std::atomic<uint64_t> failed;
+};
+
+#endif //V2V_PROTOCOL_DEMO_BATCHSENDER_HPP
@@ -0,0 +1,919 @@
+// Vera requires this "Copyright" notice
+
+#include "V2VService.hpp"
+#include "cluon/UDPReceiver.hpp"
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iomanip>
+#include <new>
+
+/********************************************************/
+/** Allocation counting *********************************/
+/********************************************************/
+static std::atomic<uint64_t> ALLOCATIONS(0);
+
+/*
+ * Every form of new and delete is replaced, so each pair ends up in malloc and free.
+ * Both stay out of line: a delete inlined next to its new would show gcc a free()
+ * of what operator new returned.
+ */
+__attribute__((noinline)) static void *allocate(size_t size) noexcept
+{
+    ALLOCATIONS.fetch_add(1, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+__attribute__((noinline)) static void release(void *p) noexcept
+{
+    std::free(p);
+}
+
+void *operator new(size_t size)
+{
+    void *p = allocate(size);
+    if (nullptr == p) {throw std::bad_alloc();}
+    return p;
+}
+
+void *operator new[](size_t size)
+{
+    void *p = allocate(size);
+    if (nullptr == p) {throw std::bad_alloc();}
+    return p;
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+    return allocate(size);
+}
+
+void operator delete(void *p) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+    release(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+    release(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+    release(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+    release(p);
+}
+
+
+/********************************************************/
+/** Harness *********************************************/
+/********************************************************/
+static uint64_t ITERATIONS = 1000000;
+
+// Keeps results observable so the compiler cannot drop the measured work
+static volatile uint64_t SINK;
+
+// Same for a whole object, e.g. a decoded message whose fields nothing reads
+template <class T>
+static void keep(T &value)
+{
+    __asm__ __volatile__("" : : "g"(&value) : "memory");
+}
+
+/**
+ * Runs an operation repeatedly and prints ns/op, messages/s and allocations/op.
+ *
+ * @param name - label of the measurement
+ * @param iterations - number of timed operations
+ * @param op - operation to measure
+ */
+template <class F>
+static void run(const std::string &name, uint64_t iterations, F &&op)
+{
+    for (uint64_t i = 0; i < iterations / 10; i++) {op();}
+
+    const uint64_t allocationsBefore = ALLOCATIONS.load(std::memory_order_relaxed);
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; i++) {op();}
+    const auto end = std::chrono::steady_clock::now();
+    const uint64_t allocations = ALLOCATIONS.load(std::memory_order_relaxed) - allocationsBefore;
+
+    const double ns = static_cast<double>(
+        std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+    const double nsPerOp = ns / static_cast<double>(iterations);
+    std::cout << std::left << std::setw(52) << name << std::right << std::fixed
+              << std::setprecision(1) << std::setw(10) << nsPerOp << " ns/op"
+              << std::setprecision(0) << std::setw(14) << 1e9 / nsPerOp << " msg/s"
+              << std::setprecision(2) << std::setw(10)
+              << static_cast<double>(allocations) / static_cast<double>(iterations)
+              << " alloc/op" << std::endl;
+}
+
+
+/********************************************************/
+/** Codec ***********************************************/
+/********************************************************/
+
+/**
+ * Measures encode, extract and decode of one message type in both framings.
+ *
+ * @tparam T - generic message type
+ * @param msg - filled sample message
+ */
+template <class T>
+static void benchCodec(T msg)
+{
+    const std::string name = T::LongName();
+    char buffer[MAX_FRAME_SIZE];
+
+    for (WireFormat format : {WireFormat::BINARY, WireFormat::HEX})
+    {
+        const std::string suffix = WireFormat::BINARY == format ? " [binary]" : " [hex]";
+        const size_t length = V2VService::encode(msg, format, buffer, sizeof(buffer));
+
+        run("encode<" + name + ">" + suffix, ITERATIONS, [&]()
+            {
+                SINK = V2VService::encode(msg, format, buffer, sizeof(buffer));
+            });
+        run("extract<" + name + ">" + suffix, ITERATIONS, [&]()
+            {
+                SINK = V2VService::extract(std::string_view(buffer, length)).length;
+            });
+        const WireFrame frame = V2VService::extract(std::string_view(buffer, length));
+        run("decode<" + name + ">" + suffix, ITERATIONS, [&]()
+            {
+                T decoded = V2VService::decode<T>(frame);
+                keep(decoded);
+            });
+    }
+}
+
+static void benchCodecs()
+{
+    AnnouncePresence announcePresence;
+    announcePresence.vehicleIp("192.168.8.1").groupId("7");
+    FollowRequest followRequest;
+    followRequest.status(1);
+    FollowResponse followResponse;
+    followResponse.status(1);
+    StopFollow stopFollow;
+    stopFollow.status(1);
+    LeaderStatus leaderStatus;
+    leaderStatus.timestamp(1524000000000).speed(0.25f).steeringAngle(-0.1f).distanceTraveled(3);
+    FollowerStatus followerStatus;
+    followerStatus.status(1);
+    opendlv::proxy::AccelerationReading acceleration;
+    acceleration.accelerationX(0.1f).accelerationY(0.2f).accelerationZ(9.81f);
+    opendlv::proxy::PedalPositionReading pedal;
+    pedal.percent(0.2f);
+    opendlv::proxy::GroundSteeringReading steering;
+    steering.steeringAngle(0.3f);
+    UltrasonicFront ultrasonic;
+    ultrasonic.readingCm(42);
+    readingsIMU imu;
+    imu.readingDistanceTraveled(2).readingSteeringAngle(0.3f).readingSpeed(0.2f);
+    LeaderId leaderId;
+    leaderId.groupId("7");
+    Kill kill;
+    kill.init(1);
+    LinkQuality linkQuality;
+    linkQuality.metric(1).count(40).p50(900).p99(4000).p999(8000).max(9000);
+    const StatusResolution resolution = {1524000000000 - 600000, 0.001f, 0.001f};
+    CompactLeaderStatus compactLeaderStatus = compactStatus(leaderStatus, 12000, resolution);
+
+    benchCodec(announcePresence);
+    benchCodec(followRequest);
+    benchCodec(followResponse);
+    benchCodec(stopFollow);
+    benchCodec(leaderStatus);
+    benchCodec(compactLeaderStatus);
+    benchCodec(followerStatus);
+    benchCodec(acceleration);
+    benchCodec(pedal);
+    benchCodec(steering);
+    benchCodec(ultrasonic);
+    benchCodec(imu);
+    benchCodec(leaderId);
+    benchCodec(kill);
+    benchCodec(linkQuality);
+
+    // Ten minutes into a session, the compact form is what goes over the air at the highest rate
+    char buffer[MAX_FRAME_SIZE];
+    run("compactStatus + encode [binary]", ITERATIONS, [&]()
+        {
+            CompactLeaderStatus compact = compactStatus(leaderStatus, 12000, resolution);
+            SINK = V2VService::encode(compact, WireFormat::BINARY, buffer, sizeof(buffer));
+        });
+    std::cout << "LeaderStatus frame: "
+              << V2VService::encode(leaderStatus, WireFormat::BINARY, buffer, sizeof(buffer))
+              << " bytes [binary], "
+              << V2VService::encode(leaderStatus, WireFormat::HEX, buffer, sizeof(buffer))
+              << " bytes [hex]; CompactLeaderStatus frame: "
+              << V2VService::encode(compactLeaderStatus, WireFormat::BINARY, buffer, sizeof(buffer))
+              << " bytes [binary]" << std::endl;
+}
+
+
+/********************************************************/
+/** Receive dispatch ************************************/
+/********************************************************/
+
+template <class T>
+static std::string frameOf(T msg)
+{
+    char buffer[MAX_FRAME_SIZE];
+    const size_t length = V2VService::encode(msg, WireFormat::BINARY, buffer, sizeof(buffer));
+    return std::string(buffer, length);
+}
+
+/**
+ * Runs datagrams through V2VService::receive on an offline instance,
+ * so extract, decode, bookkeeping and the follower fan-out encode are
+ * measured without sockets.
+ */
+static void benchDispatch()
+{
+    // Long enough that no liveness timer expires during a measurement
+    V2VConfig config;
+    config.timeDiff = 1000;
+    V2VService service(config);
+    const std::string sender = "10.0.0.2:50001";
+    const auto ts = std::chrono::system_clock::now();
+
+    // Pair both ways first so status messages hit the follower table and the leader slot
+    service.receive(frameOf(FollowRequest().status(1)), sender, ts);
+    service.followRequest("10.0.0.2");
+
+    const std::string followRequest = frameOf(FollowRequest().status(1));
+    const std::string followResponse = frameOf(FollowResponse().status(1)
+        .statusFormat(static_cast<uint8_t>(StatusFormat::COMPACT)).sessionStart(1524000000000)
+        .speedResolution(0.001f).steeringResolution(0.001f));
+    const std::string followerStatus = frameOf(FollowerStatus().status(1));
+    const std::string leaderStatus = frameOf(LeaderStatus().timestamp(1524000000000)
+        .speed(0.25f).steeringAngle(-0.1f).distanceTraveled(3));
+    const std::string compactLeaderStatus = frameOf(CompactLeaderStatus().sequence(1)
+        .timestamp(600000).speed(250).steeringAngle(-100).distanceTraveled(3));
+    const std::string unknown = frameOf(Kill().init(1));
+
+    run("receive FollowRequest (known follower)", ITERATIONS, [&]()
+        {
+            service.receive(followRequest, sender, ts);
+        });
+    run("receive FollowResponse", ITERATIONS, [&]()
+        {
+            service.receive(followResponse, sender, ts);
+        });
+    run("receive FollowerStatus", ITERATIONS, [&]()
+        {
+            service.receive(followerStatus, sender, ts);
+        });
+    run("receive LeaderStatus", ITERATIONS, [&]()
+        {
+            service.receive(leaderStatus, sender, ts);
+        });
+    run("receive CompactLeaderStatus", ITERATIONS, [&]()
+        {
+            service.receive(compactLeaderStatus, sender, ts);
+        });
+    run("receive unknown message", ITERATIONS, [&]()
+        {
+            service.receive(unknown, sender, ts);
+        });
+    run("leaderStatus fan-out encode (1 follower)", ITERATIONS, [&]()
+        {
+            service.leaderStatus();
+        });
+    run("vehicleStateChanged (below threshold)", ITERATIONS, [&]()
+        {
+            service.vehicleStateChanged();
+        });
+}
+
+
+/**
+ * Handlers that only count, so the registry itself is what gets measured.
+ */
+struct CountingOwner
+{
+    uint64_t handled = 0;
+
+    void onFollowerStatus(FollowerStatus &msg, const int &) { handled += msg.status(); }
+    void onLeaderStatus(LeaderStatus &msg, const int &) { handled += msg.distanceTraveled(); }
+};
+
+typedef MessageRegistry<CountingOwner, int,
+    Message<FOLLOW_REQUEST, FollowRequest>,
+    Message<FOLLOW_RESPONSE, FollowResponse>,
+    Message<STOP_FOLLOW, StopFollow>,
+    Message<LEADER_STATUS, LeaderStatus>,
+    Message<COMPACT_LEADER_STATUS, CompactLeaderStatus>,
+    Message<FOLLOWER_STATUS, FollowerStatus>> CountingRegistry;
+
+/**
+ * Cost of finding the handler of an extracted frame: the registry against
+ * the switch over message IDs it replaced, then its early exits.
+ */
+static void benchRegistry()
+{
+    CountingOwner owner;
+    CountingRegistry registry;
+    registry.on<FollowerStatus>(&CountingOwner::onFollowerStatus);
+    registry.on<LeaderStatus>(&CountingOwner::onLeaderStatus);
+    const int context = 0;
+
+    const std::string followerStatus = frameOf(FollowerStatus().status(1));
+    const std::string stopFollow = frameOf(StopFollow().status(1));
+    const std::string unknown = frameOf(Kill().init(1));
+    const WireFrame followerStatusFrame = V2VService::extract(followerStatus);
+    const WireFrame stopFollowFrame = V2VService::extract(stopFollow);
+    const WireFrame unknownFrame = V2VService::extract(unknown);
+
+    run("switch: FollowerStatus decode + handler", ITERATIONS, [&]()
+        {
+            switch (followerStatusFrame.id)
+            {
+                case FOLLOW_REQUEST: SINK = 1; break;
+                case FOLLOW_RESPONSE: SINK = 2; break;
+                case STOP_FOLLOW: SINK = 3; break;
+                case LEADER_STATUS:
+                {
+                    LeaderStatus msg = V2VService::decode<LeaderStatus>(followerStatusFrame);
+                    owner.onLeaderStatus(msg, context);
+                } break;
+                case FOLLOWER_STATUS:
+                {
+                    FollowerStatus msg = V2VService::decode<FollowerStatus>(followerStatusFrame);
+                    owner.onFollowerStatus(msg, context);
+                } break;
+                default: SINK = 0;
+            }
+        });
+    run("registry: FollowerStatus decode + handler", ITERATIONS, [&]()
+        {
+            SINK = static_cast<uint64_t>(registry.dispatch(owner, followerStatusFrame, context));
+        });
+    run("registry: StopFollow without handler", ITERATIONS, [&]()
+        {
+            SINK = static_cast<uint64_t>(registry.dispatch(owner, stopFollowFrame, context));
+        });
+    run("registry: unknown ID", ITERATIONS, [&]()
+        {
+            SINK = static_cast<uint64_t>(registry.dispatch(owner, unknownFrame, context));
+        });
+    SINK = owner.handled;
+}
+
+/********************************************************/
+/** Presence table **************************************/
+/********************************************************/
+
+/**
+ * Announcements, lookups and leader selection with a fleet of 64 cars
+ * spread over 8 groups.
+ */
+static void benchPresence()
+{
+    const size_t cars = 64;
+    PresenceTable presence(MAX_PRESENT_CARS, 2000000);
+    std::vector<std::string> ips;
+    std::vector<std::string> groups;
+    for (size_t i = 0; i < cars; i++)
+    {
+        ips.push_back("192.168." + std::to_string(i / 250) + "." + std::to_string(i % 250 + 1));
+        groups.push_back(std::to_string(i % 8));
+    }
+    uint64_t now = 1;
+    for (size_t i = 0; i < cars; i++) {presence.update(ips[i], groups[i], now);}
+
+    size_t next = 0;
+    std::string leader;
+    leader.reserve(PresenceTable::IP_SIZE);
+    run("presence update (64 cars)", ITERATIONS, [&]()
+        {
+            presence.update(ips[next], groups[next], ++now);
+            next = (next + 1) % cars;
+        });
+    run("presence find (64 cars)", ITERATIONS, [&]()
+        {
+            SINK = presence.find(ips[next], now);
+            next = (next + 1) % cars;
+        });
+    run("presence leader selection (64 cars)", ITERATIONS, [&]()
+        {
+            SINK = presence.leader(groups[next], now, leader);
+            next = (next + 1) % cars;
+        });
+    run("presence forget + update (64 cars)", ITERATIONS, [&]()
+        {
+            presence.forget(ips[next]);
+            presence.update(ips[next], groups[next], ++now);
+            next = (next + 1) % cars;
+        });
+}
+
+
+/********************************************************/
+/** Jitter buffer ***************************************/
+/********************************************************/
+
+/**
+ * A LeaderStatus every 50 ms played out every 20 ms, one in eight arriving after
+ * its playout time.
+ */
+static void benchPlayout()
+{
+    JitterBuffer buffer(100, 250);
+    Setpoint setpoint;
+    uint64_t now = 1524000000000;
+    uint64_t sent = now;
+    uint64_t i = 0;
+    StatusSample late = {0, 0.0f, 0.0f, 0};
+    run("jitter buffer insert + playout", ITERATIONS, [&]()
+        {
+            now += 20;
+            if (now >= sent + 50)
+            {
+                sent += 50;
+                StatusSample sample = {sent, static_cast<float>(i % 100) / 100.0f, 0.1f, 1};
+                if (0 == i % 8) {late = sample;}
+                else {buffer.insert(sample, now + 5);}
+                i++;
+            }
+            if (0 != late.timestamp && now >= late.timestamp + 150)
+            {
+                buffer.insert(late, now);
+                late.timestamp = 0;
+            }
+            SINK = buffer.playout(now, setpoint);
+        });
+    const PlayoutCounters counters = buffer.counters(true);
+    std::cout << "jitter buffer: " << counters.interpolated << " interpolated, "
+              << counters.extrapolated << " extrapolated, " << counters.held << " held, "
+              << counters.stale << " stale" << std::endl;
+}
+
+
+/********************************************************/
+/** Mirror stage ****************************************/
+/********************************************************/
+
+/**
+ * Cost of posting to the mirror stage on a protocol thread, with the
+ * background thread draining at 10 Hz into a sink that discards payloads.
+ */
+static void benchMirror()
+{
+    MirrorStage stage;
+    stage.rate(10.0f);
+    stage.start([](int32_t, const std::string &payload, int64_t) { SINK = payload.size(); });
+
+    LeaderStatus leaderStatus;
+    leaderStatus.timestamp(1524000000000).speed(0.25f).steeringAngle(-0.1f).distanceTraveled(3);
+    run("mirror post LeaderStatus", ITERATIONS, [&]()
+        {
+            stage.post(leaderStatus);
+        });
+    stage.stop();
+
+    MirrorStage::TypeCounters counters[MirrorStage::MAX_TYPES];
+    const size_t types = stage.counters(counters, MirrorStage::MAX_TYPES, false);
+    for (size_t i = 0; i < types; i++)
+    {
+        std::cout << "mirror " << counters[i].id << ": " << counters[i].posted << " posted, "
+                  << counters[i].sent << " sent" << std::endl;
+    }
+}
+
+
+/********************************************************/
+/** Recorder ********************************************/
+/********************************************************/
+
+/**
+ * Cost of recording a datagram on the receive path, with the writer thread
+ * appending to /dev/null.
+ */
+static void benchRecorder()
+{
+    Recorder recorder;
+    if (not recorder.open("/dev/null")) {return;}
+    const std::string frame = frameOf(LeaderStatus().timestamp(1524000000000)
+        .speed(0.25f).steeringAngle(-0.1f).distanceTraveled(3));
+    const std::string sender = "10.0.0.2:50001";
+    const auto ts = std::chrono::system_clock::now();
+    run("record LeaderStatus frame", ITERATIONS, [&]()
+        {
+            recorder.frame(frame, sender, ts);
+        });
+    recorder.close();
+    std::cout << "recorder: " << recorder.recorded() << " recorded, " << recorder.dropped()
+              << " dropped on a full buffer" << std::endl;
+}
+
+
+/********************************************************/
+/** Receive load ****************************************/
+/********************************************************/
+
+/**
+ * Floods a loopback port with FollowerStatus datagrams from a known follower
+ * and counts how many make it through V2VService::receive, first with
+ * cluon::UDPReceiver dispatching inline (the receive path before
+ * ReceivePipeline), then through ReceivePipeline.
+ *
+ * @param seconds - duration of each flood
+ */
+static void benchLoad(double seconds)
+{
+    const uint16_t port = 50901;
+    V2VService service{V2VConfig()};
+    const auto ts = std::chrono::system_clock::now();
+    service.receive(frameOf(FollowRequest().status(1)), "127.0.0.1:50001", ts);
+    const std::string frame = frameOf(FollowerStatus().status(1));
+
+    std::atomic<uint64_t> processed(0);
+    auto handler = [&](std::string_view data, std::string_view sender,
+        const std::chrono::system_clock::time_point &arrival)
+        {
+            service.receive(data, sender, arrival);
+            processed.fetch_add(1, std::memory_order_relaxed);
+        };
+
+    auto flood = [&](const std::string &name)
+        {
+            BatchSender generator;
+            BatchTarget targets[64];
+            for (BatchTarget &target : targets)
+            {
+                BatchSender::resolve("127.0.0.1", port, target.address);
+                target.header = frame.data();
+                target.headerLength = frame.size();
+            }
+
+            processed = 0;
+            std::atomic<bool> done(false);
+            uint64_t sent = 0;
+            std::thread sender([&]()
+                {
+                    while (not done.load(std::memory_order_relaxed))
+                    {
+                        sent += generator.send(targets, 64, frame.data(), 0);
+                    }
+                });
+            std::this_thread::sleep_for(std::chrono::duration<double>(seconds));
+            const uint64_t handled = processed.load();
+            done = true;
+            sender.join();
+
+            std::cout << std::left << std::setw(52) << name << std::right << std::fixed
+                      << std::setprecision(0) << std::setw(12) << static_cast<double>(sent) / seconds
+                      << " sent/s" << std::setw(12) << static_cast<double>(handled) / seconds
+                      << " handled/s" << std::endl;
+        };
+
+    {
+        cluon::UDPReceiver receiver("0.0.0.0", port,
+            [&](std::string &&data, std::string &&sender, std::chrono::system_clock::time_point &&arrival)
+            {
+                handler(data, sender, arrival);
+            });
+        flood("load: cluon::UDPReceiver, inline dispatch");
+    }
+    {
+        ReceivePipeline pipeline;
+        if (not pipeline.start(handler) || not pipeline.listen("0.0.0.0", port))
+        {
+            std::cout << "load: port " << port << " unavailable" << std::endl;
+            return;
+        }
+        flood("load: ReceivePipeline, recvmmsg + worker");
+        std::cout << "load: " << pipeline.received() << " received in " << pipeline.batches()
+                  << " recvmmsg calls, " << pipeline.dropped() << " dropped on a full ring"
+                  << std::endl;
+    }
+}
+
+
+/********************************************************/
+/** Internal channel ************************************/
+/********************************************************/
+
+/**
+ * Sends rounds payloads, one per millisecond so the receiver is asleep each
+ * time, and records how long each took to reach the receiving thread.
+ *
+ * @param send - sends payload number i, the 8 bytes of i
+ * @param sentAt - steady clock nanoseconds each payload was sent at
+ * @param latency - recorded into by the receiving side
+ */
+template <class F>
+static void measureInternal(const std::string &name, uint64_t rounds, F &&send,
+    std::vector<uint64_t> &sentAt, Histogram &latency)
+{
+    for (uint64_t i = 0; i < rounds; i++)
+    {
+        sentAt[i] = static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+        send(i);
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    for (int wait = 0; wait < 100 && latency.summary(false).count < rounds; wait++)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+
+    const HistogramSummary s = latency.summary(true);
+    std::cout << std::left << std::setw(52) << name << std::right << std::fixed
+              << std::setprecision(1) << std::setw(10) << s.p50 / 1e3 << " us p50"
+              << std::setw(10) << s.p99 / 1e3 << " us p99" << std::setw(10) << s.max / 1e3
+              << " us max" << std::setw(8) << s.count << "/" << rounds << " delivered" << std::endl;
+}
+
+/**
+ * Latency from the dash to the receiving thread of the service, over the OD4
+ * session of the internal channel and over a SharedRing.
+ *
+ * @param rounds - payloads sent on each path
+ */
+static void benchInternal(uint64_t rounds)
+{
+    const int32_t id = IMU;
+    std::vector<uint64_t> sentAt(rounds);
+    Histogram latency;
+    auto arrived = [&](std::string_view payload)
+        {
+            uint64_t i;
+            if (payload.size() != sizeof(i)) {return;}
+            std::memcpy(&i, payload.data(), sizeof(i));
+            if (i >= rounds) {return;}
+            const uint64_t now = static_cast<uint64_t>(
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now().time_since_epoch()).count());
+            latency.record(now - sentAt[i]);
+        };
+
+    {
+        // A channel of its own, so a service running on the host is not fed IMU readings
+        cluon::OD4Session service(INTERNAL_CHANNEL + 100, [&](cluon::data::Envelope &&envelope)
+            {
+                if (id == envelope.dataType()) {arrived(envelope.serializedData());}
+            });
+        cluon::OD4Session dash(INTERNAL_CHANNEL + 100);
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        measureInternal("internal: OD4 session, multicast", rounds, [&](uint64_t i)
+            {
+                cluon::data::Envelope envelope;
+                envelope.dataType(id);
+                envelope.serializedData(std::string(reinterpret_cast<const char *>(&i), sizeof(i)));
+                dash.send(std::move(envelope));
+            }, sentAt, latency);
+    }
+    {
+        const std::string name = "/v2v-bench";
+        SharedRing service;
+        SharedRing dash;
+        if (not service.create(name) || not dash.attach(name)
+            || not service.start([&](int32_t, std::string_view payload, int64_t) {arrived(payload);}))
+        {
+            std::cout << "internal: cannot create shared memory " << name << std::endl;
+            return;
+        }
+        measureInternal("internal: SharedRing, futex wake-up", rounds, [&](uint64_t i)
+            {
+                dash.write(id, reinterpret_cast<const char *>(&i), sizeof(i), 0);
+            }, sentAt, latency);
+        std::cout << "internal: " << dash.written() << " written, " << dash.wakeups()
+                  << " wake-up calls" << std::endl;
+    }
+}
+
+
+/********************************************************/
+/** Steady state ****************************************/
+/********************************************************/
+
+/**
+ * Pairs a leader and a follower and counts the heap allocations of every
+ * thread while they exchange LeaderStatus and FollowerStatus. Once paired,
+ * the leader has no room left to announce itself and the follower takes no
+ * followers, so nothing but statuses, their timers, playout and statistics
+ * run.
+ *
+ * Both cars publish to a sink that only counts, so the mirror stage, the
+ * setpoints the follower plays out and the statistics publishers are part
+ * of the measurement; what the sink itself costs in main.cpp (OD4 envelopes
+ * or a SharedRing) is not. On loopback the cars send with sendmmsg and
+ * receive with recvmmsg on 127.0.0.1 and 127.0.0.2, the broadcast channel
+ * stays unused either way.
+ *
+ * @param seconds - length of the measurement, after a second of warm-up
+ * @param loopback - UdpTransport on loopback instead of a MemoryNetwork
+ * @return false if anything was allocated, or no status or setpoint went through
+ */
+static bool benchSteadyState(double seconds, bool loopback)
+{
+    MemoryNetwork network;
+    auto transport = [&]() -> std::unique_ptr<Transport>
+        {
+            if (loopback)
+            {
+                return std::unique_ptr<Transport>(new UdpTransport(BROADCAST_CHANNEL, DEFAULT_PORT, true));
+            }
+            return std::unique_ptr<Transport>(new MemoryTransport(network, DEFAULT_PORT));
+        };
+    V2VConfig leaderConfig;
+    leaderConfig.ip = loopback ? "127.0.0.1" : "10.0.0.1";
+    leaderConfig.maxFollowers = 1;
+    leaderConfig.statsInterval = 400;
+    V2VConfig followerConfig;
+    followerConfig.ip = loopback ? "127.0.0.2" : "10.0.0.2";
+    followerConfig.maxFollowers = 0;
+    followerConfig.statsInterval = 400;
+    V2VService leader(leaderConfig, transport());
+    V2VService follower(followerConfig, transport());
+
+    std::atomic<uint64_t> published(0);
+    std::atomic<uint64_t> setpoints(0);
+    leader.publishTo([&published](int32_t, const std::string &, int64_t)
+        {
+            published.fetch_add(1, std::memory_order_relaxed);
+        });
+    follower.publishTo([&published, &setpoints](int32_t id, const std::string &, int64_t)
+        {
+            published.fetch_add(1, std::memory_order_relaxed);
+            if (LEADER_STATUS == id) {setpoints.fetch_add(1, std::memory_order_relaxed);}
+        });
+    const std::string leaderIp = leaderConfig.ip;
+    follower.post([&follower, leaderIp]() { follower.followRequest(leaderIp); });
+
+    // The leader drives at 50 Hz with a speed that changes enough for every step to be sent
+    const auto period = std::chrono::milliseconds(20);
+    const uint64_t ticksEvery = static_cast<uint64_t>(1000.0f / leaderConfig.frequency) / 20;
+    auto drive = [&](double duration)
+        {
+            const uint64_t steps = static_cast<uint64_t>(duration * 50.0);
+            auto next = std::chrono::steady_clock::now();
+            for (uint64_t step = 0; step < steps; step++)
+            {
+                VehicleState state;
+                state.speed = static_cast<float>(std::sin(static_cast<double>(step) * 0.1));
+                state.steeringAngle = 0.1f;
+                state.distanceTraveled = static_cast<uint8_t>(step);
+                leader.vehicleState(state);
+                if (0 == step % ticksEvery)
+                {
+                    leader.post([&leader]() { leader.tick(); });
+                    follower.post([&follower]() { follower.tick(); });
+                }
+                next += period;
+                std::this_thread::sleep_until(next);
+            }
+        };
+    auto datagrams = [&]()
+        {
+            return leader.sendCounters().datagrams + follower.sendCounters().datagrams;
+        };
+
+    drive(1.0);
+    const uint64_t datagramsBefore = datagrams();
+    const uint64_t publishedBefore = published.load();
+    const uint64_t setpointsBefore = setpoints.load();
+    const uint64_t allocationsBefore = ALLOCATIONS.load(std::memory_order_relaxed);
+    drive(seconds);
+    const uint64_t allocations = ALLOCATIONS.load(std::memory_order_relaxed) - allocationsBefore;
+    const uint64_t sent = datagrams() - datagramsBefore;
+    const uint64_t played = setpoints.load() - setpointsBefore;
+    const uint64_t payloads = published.load() - publishedBefore;
+
+    std::cout << "steady state, " << (loopback ? "loopback" : "memory") << " (" << seconds
+              << "s): " << sent << " datagrams, " << payloads << " published, " << played
+              << " setpoints, " << allocations << " allocations" << std::endl;
+    return 0 == allocations && sent > 0 && played > 0;
+}
+
+
+/********************************************************/
+/** Vehicle state ***************************************/
+/********************************************************/
+
+/**
+ * One thread publishes VehicleState snapshots while this thread loads them.
+ * Every published snapshot is internally consistent, so a load that mixes
+ * fields of two publishes is counted as torn.
+ *
+ * @param seconds - length of the run
+ * @return false if a load was torn or nothing was published and loaded
+ */
+static bool benchVehicleState(double seconds)
+{
+    SeqLock<VehicleState> state;
+    std::atomic<bool> done(false);
+    uint64_t publishes = 0;
+
+    std::thread writer([&]()
+        {
+            for (uint64_t i = 1; not done.load(std::memory_order_relaxed); i++)
+            {
+                VehicleState s;
+                s.speed = static_cast<float>(i % 100000);
+                s.steeringAngle = -s.speed;
+                s.distanceTraveled = static_cast<uint8_t>(i % 100000);
+                s.sampleTime = i % 100000;
+                state.publish(s);
+                publishes = i;
+            }
+        });
+
+    uint64_t loads = 0;
+    uint64_t torn = 0;
+    const auto end = std::chrono::steady_clock::now()
+        + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(seconds));
+    while (std::chrono::steady_clock::now() < end)
+    {
+        const VehicleState s = state.load();
+        if (s.steeringAngle != -s.speed || s.sampleTime != static_cast<uint64_t>(s.speed)
+            || s.distanceTraveled != static_cast<uint8_t>(s.sampleTime))
+        {
+            torn++;
+        }
+        loads++;
+    }
+    done = true;
+    writer.join();
+
+    std::cout << "VehicleState seqlock (" << seconds << "s): " << publishes << " publishes, "
+              << loads << " loads, " << torn << " torn reads" << std::endl;
+    return 0 == torn && publishes > 0 && loads > 0;
+}
+
+
+int main(int argc, char **argv)
+{
+    auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
+    if (commandlineArguments.count("iterations") != 0)
+    {
+        ITERATIONS = std::stoull(commandlineArguments["iterations"]);
+    }
+    // Logging is part of dispatch cost only when asked for, it would flood the output otherwise
+    if (commandlineArguments.count("log") == 0)
+    {
+        AsyncLog::instance().level(V2V_LOG_OFF);
+    }
+
+    // Checks instead of measuring, fails when the status exchange allocates
+    if (commandlineArguments.count("steady") != 0)
+    {
+        const double seconds = std::stod(commandlineArguments["steady"]);
+        const bool memory = benchSteadyState(seconds, false);
+        const bool loopback = benchSteadyState(seconds, true);
+        return memory && loopback ? 0 : 1;
+    }
+    // Checks instead of measuring, fails when a load of the vehicle state is torn
+    if (commandlineArguments.count("seqlock") != 0)
+    {
+        return benchVehicleState(std::stod(commandlineArguments["seqlock"])) ? 0 : 1;
+    }
+
+    benchCodecs();
+    benchDispatch();
+    benchRegistry();
+    benchPresence();
+    benchPlayout();
+    benchMirror();
+    benchRecorder();
+    benchVehicleState(1.0);
+
+    // Opt-in, it needs multicast and shared memory and sends one payload per millisecond
+    if (commandlineArguments.count("internal") != 0)
+    {
+        benchInternal(std::stoull(commandlineArguments["internal"]));
+    }
+    // Opt-in, it saturates loopback for a few seconds
+    if (commandlineArguments.count("load") != 0)
+    {
+        benchLoad(std::stod(commandlineArguments["load"]));
+    }
+    return 0;
+}
@@ -0,0 +1,133 @@
+// Vera requires this "Copyright" notice
+
+#include "Bundler.hpp"
+
+#include <cstring>
+
+/**
+ * @param deadlineMs - longest a message waits for others, 0 sends every one at once
+ * @param send - hands a finished datagram to the network
+ */
+Bundler::Bundler(uint32_t deadlineMs, Send send)
+    : deadline(static_cast<uint64_t>(deadlineMs) * 1000), sendFrame(std::move(send)), armed(false)
+{
+}
+
+/**
+ * Queues an encoded message for a car.
+ *
+ * @param to - endpoint of the car
+ * @param id - message ID
+ * @param payload - encoded message without frame header
+ * @param length - payload length
+ * @param urgent - send it now, together with what is pending for the car
+ * @param nowMicros - monotonic microseconds
+ * @return true if the caller must call flush() after the deadline
+ */
+bool Bundler::add(const sockaddr_in &to, int32_t id, const char *payload, size_t length,
+    bool urgent, uint64_t nowMicros)
+{
+    if (BINARY_HEADER_SIZE + length > MAX_FRAME_SIZE) {return false;}
+    std::lock_guard<std::mutex> lock(mutex);
+    Pending *bundle = find(to);
+    if (bundle->length + BUNDLE_ENTRY_SIZE + length > sizeof(bundle->frame))
+    {
+        send(*bundle);
+        // Too large to share a datagram with anything, it goes out on its own
+        if (bundle->length + BUNDLE_ENTRY_SIZE + length > sizeof(bundle->frame))
+        {
+            char frame[MAX_FRAME_SIZE];
+            writeWireHeader(WireFormat::BINARY, id, length, frame);
+            std::memcpy(frame + BINARY_HEADER_SIZE, payload, length);
+            sendFrame(to, frame, BINARY_HEADER_SIZE + length);
+            return false;
+        }
+    }
+    char *entry = bundle->frame + bundle->length;
+    entry[0] = static_cast<char>(id & 0xFF);
+    entry[1] = static_cast<char>((id >> 8) & 0xFF);
+    entry[2] = static_cast<char>(length & 0xFF);
+    entry[3] = static_cast<char>((length >> 8) & 0xFF);
+    std::memcpy(entry + BUNDLE_ENTRY_SIZE, payload, length);
+    bundle->length += BUNDLE_ENTRY_SIZE + length;
+    if (0 == bundle->count++) {bundle->due = nowMicros + deadline;}
+
+    if (urgent || 0 == deadline)
+    {
+        send(*bundle);
+        return false;
+    }
+    if (armed) {return false;}
+    armed = true;
+    return true;
+}
+
+/**
+ * Sends every datagram whose first message waited for the deadline.
+ *
+ * @param nowMicros - monotonic microseconds
+ * @return milliseconds until the next datagram is due, 0 if nothing is pending
+ */
+uint32_t Bundler::flush(uint64_t nowMicros)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint64_t next = UINT64_MAX;
+    for (Pending &bundle : pending)
+    {
+        if (0 == bundle.count) {continue;}
+        if (bundle.due <= nowMicros) {send(bundle);}
+        else if (bundle.due < next) {next = bundle.due;}
+    }
+    armed = UINT64_MAX != next;
+    return armed ? static_cast<uint32_t>((next - nowMicros + 999) / 1000) : 0;
+}
+
+/**
+ * @return the pending datagram for a car, taking an empty one if it has none
+ */
+Bundler::Pending *Bundler::find(const sockaddr_in &to)
+{
+    Pending *empty = nullptr;
+    for (Pending &bundle : pending)
+    {
+        if (bundle.to.sin_addr.s_addr == to.sin_addr.s_addr && bundle.to.sin_port == to.sin_port)
+        {
+            return &bundle;
+        }
+        if (nullptr == empty && 0 == bundle.count) {empty = &bundle;}
+    }
+    if (nullptr == empty)
+    {
+        pending.emplace_back();
+        empty = &pending.back();
+        empty->count = 0;
+    }
+    empty->to = to;
+    empty->length = BINARY_HEADER_SIZE;
+    return empty;
+}
+
+/**
+ * Sends a pending datagram and empties it. A single message goes out as its
+ * own binary frame, its entry is the tail of that frame's header.
+ */
+void Bundler::send(Pending &bundle)
+{
+    if (0 == bundle.count) {return;}
+    if (1 == bundle.count)
+    {
+        // ID and length of the entry are the end of a binary header, magic and version complete it
+        const size_t start = BINARY_HEADER_SIZE - (BINARY_HEADER_SIZE - BUNDLE_ENTRY_SIZE);
+        bundle.frame[start] = static_cast<char>(WIRE_MAGIC);
+        bundle.frame[start + 1] = static_cast<char>(WIRE_VERSION);
+        sendFrame(bundle.to, bundle.frame + start, bundle.length - start);
+    }
+    else
+    {
+        writeWireHeader(WireFormat::BINARY, WIRE_BUNDLE, bundle.length - BINARY_HEADER_SIZE,
+            bundle.frame);
+        sendFrame(bundle.to, bundle.frame, bundle.length);
+    }
+    bundle.length = BINARY_HEADER_SIZE;
+    bundle.count = 0;
+}
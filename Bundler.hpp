@@ -0,0 +1,57 @@
+#ifndef V2V_PROTOCOL_DEMO_BUNDLER_HPP
+#define V2V_PROTOCOL_DEMO_BUNDLER_HPP
+
+#include <netinet/in.h>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <vector>
+#include "WireCodec.hpp"
+
+
+/**
+ * Packs the messages for one car into a single WIRE_BUNDLE datagram.
+ *
+ * Every car has a pending datagram. A message is appended to it and the
+ * datagram is sent once its first message waited for the deadline, when the
+ * next message would not fit, or right away for an urgent message, which
+ * takes everything pending along. A datagram holding a single message goes
+ * out as the plain binary frame of that message.
+ *
+ * Thread-safe, sends happen on the calling thread.
+ */
+class Bundler {
+public:
+    typedef std::function<void(const sockaddr_in &to, const char *frame, size_t length)> Send;
+
+    Bundler(uint32_t deadlineMs, Send send);
+    Bundler(const Bundler &) = delete;
+    Bundler &operator=(const Bundler &) = delete;
+
+    bool add(const sockaddr_in &to, int32_t id, const char *payload, size_t length, bool urgent,
+             uint64_t nowMicros);
+    uint32_t flush(uint64_t nowMicros);
+
+private:
+    struct Pending
+    {
+        sockaddr_in to;
+        char frame[MAX_FRAME_SIZE];     // outer header, then the entries
+        size_t length;
+        size_t count;
+        uint64_t due;                   // monotonic microseconds
+    };
+
+    const uint64_t deadline;            // microseconds
+    const Send sendFrame;
+
+    std::mutex mutex;
+    std::vector<Pending> pending;       // one per car sent to, reused once empty
+    bool armed;                         // a flush is scheduled for the oldest pending message
+
+    Pending *find(const sockaddr_in &to);
+    void send(Pending &bundle);
+};
+
+#endif //V2V_PROTOCOL_DEMO_BUNDLER_HPP
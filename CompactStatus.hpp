@@ -0,0 +1,93 @@
+#ifndef V2V_PROTOCOL_DEMO_COMPACTSTATUS_HPP
+#define V2V_PROTOCOL_DEMO_COMPACTSTATUS_HPP
+
+#include <cmath>
+#include <cstdint>
+#include "Messages.hpp"
+
+
+/**
+ * LeaderStatus encodings, agreed on per follower with FollowRequest and
+ * FollowResponse. Cars that do not know the field send and receive 0.
+ */
+enum class StatusFormat : uint8_t
+{
+    FULL    = 0,    // LeaderStatus, 64 bit timestamp and floats
+    COMPACT = 1     // CompactLeaderStatus, fixed point relative to a session
+};
+
+
+/**
+ * What a CompactLeaderStatus is relative to, announced by the leader in its
+ * FollowResponse.
+ */
+struct StatusResolution
+{
+    uint64_t sessionStart;      // milliseconds since the epoch, timestamps count from here
+    float speed;                // speed of one unit
+    float steeringAngle;        // steering angle of one unit
+};
+
+
+/**
+ * @return value in multiples of resolution, rounded and saturated to int32,
+ *         0 for a NaN reading
+ */
+inline int32_t quantize(float value, float resolution) noexcept
+{
+    const double units = std::round(static_cast<double>(value) / resolution);
+    // A NaN fails both comparisons below, and converting it is undefined
+    if (std::isnan(units)) {return 0;}
+    if (units >= INT32_MAX) {return INT32_MAX;}
+    if (units <= INT32_MIN) {return INT32_MIN;}
+    return static_cast<int32_t>(units);
+}
+
+/**
+ * @return true if both sides can use the resolution
+ */
+inline bool validResolution(const StatusResolution &resolution) noexcept
+{
+    return resolution.speed > 0.0f && resolution.steeringAngle > 0.0f;
+}
+
+/**
+ * Converts a LeaderStatus to its compact form. The small values go out as
+ * one to three byte varints instead of fixed 4 and 8 byte fields.
+ *
+ * @param status - status to convert, not older than the session
+ * @param sequence - number of the status within the session
+ * @param resolution - session start and resolutions agreed on
+ */
+inline CompactLeaderStatus compactStatus(const LeaderStatus &status, uint32_t sequence,
+    const StatusResolution &resolution) noexcept
+{
+    const uint64_t since = status.timestamp() > resolution.sessionStart
+        ? status.timestamp() - resolution.sessionStart : 0;
+    CompactLeaderStatus compact;
+    compact.sequence(sequence);
+    compact.timestamp(static_cast<uint32_t>(since > UINT32_MAX ? UINT32_MAX : since));
+    compact.speed(quantize(status.speed(), resolution.speed));
+    compact.steeringAngle(quantize(status.steeringAngle(), resolution.steeringAngle));
+    compact.distanceTraveled(status.distanceTraveled());
+    return compact;
+}
+
+/**
+ * Converts a CompactLeaderStatus back, speed and steering angle to within
+ * half a resolution unit of what the leader had.
+ */
+inline LeaderStatus expandStatus(const CompactLeaderStatus &compact,
+    const StatusResolution &resolution) noexcept
+{
+    LeaderStatus status;
+    status.timestamp(resolution.sessionStart + compact.timestamp());
+    status.speed(static_cast<float>(compact.speed() * static_cast<double>(resolution.speed)));
+    status.steeringAngle(static_cast<float>(
+        compact.steeringAngle() * static_cast<double>(resolution.steeringAngle)));
+    status.distanceTraveled(compact.distanceTraveled());
+    status.sequence(compact.sequence());
+    return status;
+}
+
+#endif //V2V_PROTOCOL_DEMO_COMPACTSTATUS_HPP
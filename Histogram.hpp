@@ -0,0 +1,119 @@
+#ifndef V2V_PROTOCOL_DEMO_HISTOGRAM_HPP
+#define V2V_PROTOCOL_DEMO_HISTOGRAM_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * Percentiles of a histogram, in the unit values were recorded in.
+ */
+struct HistogramSummary
+{
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t p999;
+    uint64_t max;
+};
+
+
+/**
+ * Log-linear histogram in the style of HdrHistogram.
+ *
+ * Values below 2^SUB_BUCKET_BITS get their own bucket, larger values are
+ * grouped into power-of-two ranges that are split into linear sub-buckets,
+ * which keeps the relative error below 1 / 2^(SUB_BUCKET_BITS - 1).
+ * Recording is one relaxed atomic increment, so any thread may record while
+ * another one takes summaries.
+ */
+class Histogram {
+public:
+    Histogram() noexcept : peak(0)
+    {
+        for (auto &count : bucketCounts) {count.store(0, std::memory_order_relaxed);}
+    }
+
+    void record(uint64_t value) noexcept
+    {
+        if (value > MAX_VALUE) {value = MAX_VALUE;}
+        bucketCounts[indexOf(value)].fetch_add(1, std::memory_order_relaxed);
+        uint64_t max = peak.load(std::memory_order_relaxed);
+        while (value > max
+            && not peak.compare_exchange_weak(max, value, std::memory_order_relaxed)) {}
+    }
+
+    /**
+     * Computes the percentiles of everything recorded so far.
+     *
+     * @param reset - start a new interval, values recorded meanwhile may land in either one
+     */
+    HistogramSummary summary(bool reset) noexcept
+    {
+        uint32_t counts[BUCKETS];
+        uint64_t total = 0;
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            counts[i] = reset ? bucketCounts[i].exchange(0, std::memory_order_relaxed)
+                              : bucketCounts[i].load(std::memory_order_relaxed);
+            total += counts[i];
+        }
+
+        HistogramSummary s;
+        s.count = total;
+        s.max = reset ? peak.exchange(0, std::memory_order_relaxed)
+                      : peak.load(std::memory_order_relaxed);
+        s.p50 = percentile(counts, total, 500, s.max);
+        s.p99 = percentile(counts, total, 990, s.max);
+        s.p999 = percentile(counts, total, 999, s.max);
+        return s;
+    }
+
+private:
+    static const unsigned SUB_BUCKET_BITS = 6;
+    static const uint64_t SUB_BUCKETS = 1u << SUB_BUCKET_BITS;
+    static const uint64_t HALF_BUCKETS = SUB_BUCKETS / 2;
+    static const unsigned MAX_BITS = 40;
+    static const uint64_t MAX_VALUE = (static_cast<uint64_t>(1) << MAX_BITS) - 1;
+    static const size_t BUCKETS = SUB_BUCKETS + (MAX_BITS - SUB_BUCKET_BITS) * HALF_BUCKETS;
+
+    std::atomic<uint32_t> bucketCounts[BUCKETS];
+    std::atomic<uint64_t> peak;
+
+    static size_t indexOf(uint64_t value) noexcept
+    {
+        if (value < SUB_BUCKETS) {return static_cast<size_t>(value);}
+        unsigned msb = 0;
+        for (uint64_t v = value; v > 1; v >>= 1) {msb++;}
+        const unsigned shift = msb - (SUB_BUCKET_BITS - 1);
+        return static_cast<size_t>(SUB_BUCKETS + (shift - 1) * HALF_BUCKETS
+            + ((value >> shift) - HALF_BUCKETS));
+    }
+
+    // Highest value that falls into the bucket
+    static uint64_t valueOf(size_t index) noexcept
+    {
+        if (index < SUB_BUCKETS) {return index;}
+        const uint64_t shift = (index - SUB_BUCKETS) / HALF_BUCKETS + 1;
+        const uint64_t sub = (index - SUB_BUCKETS) % HALF_BUCKETS + HALF_BUCKETS;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    // permille - percentile times ten, e.g. 999 for p99.9
+    static uint64_t percentile(const uint32_t *counts, uint64_t total, uint64_t permille,
+        uint64_t max) noexcept
+    {
+        if (0 == total) {return 0;}
+        const uint64_t rank = (total * permille + 999) / 1000;
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; i++)
+        {
+            seen += counts[i];
+            if (seen >= rank) {return valueOf(i) < max ? valueOf(i) : max;}
+        }
+        return max;
+    }
+};
+
+#endif //V2V_PROTOCOL_DEMO_HISTOGRAM_HPP
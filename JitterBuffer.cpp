@@ -0,0 +1,158 @@
+// Vera requires this "Copyright" notice
+
+#include "JitterBuffer.hpp"
+
+/**
+ * @param delayMs - how far playout runs behind the fastest packet seen
+ * @param maxExtrapolationMs - how long past the newest sample to dead-reckon
+ */
+JitterBuffer::JitterBuffer(uint32_t delayMs, uint32_t maxExtrapolationMs)
+    : delay(delayMs), maxExtrapolation(maxExtrapolationMs)
+{
+    reset();
+    stats = PlayoutCounters();
+}
+
+/**
+ * Forgets every sample and the clock mapping, e.g. when following a new leader.
+ */
+void JitterBuffer::reset()
+{
+    count = 0;
+    played = 0;
+    pendingDistance = 0;
+    offset = 0;
+    hasOffset = false;
+    lastPlayout = 0;
+}
+
+/**
+ * Puts a received sample in timestamp order.
+ *
+ * @param arrivalMs - local receive time in milliseconds since the epoch
+ * @return false if the sample was dropped
+ */
+bool JitterBuffer::insert(const StatusSample &sample, uint64_t arrivalMs)
+{
+    // Played past already, or a duplicate of something that was
+    if ((played > 0 && sample.timestamp <= previous.timestamp) || sample.timestamp <= lastPlayout)
+    {
+        stats.stale++;
+        return false;
+    }
+
+    size_t position = count;
+    while (position > 0 && samples[position - 1].timestamp > sample.timestamp) {position--;}
+    if (position > 0 && samples[position - 1].timestamp == sample.timestamp)
+    {
+        stats.stale++;
+        return false;
+    }
+    if (CAPACITY == count)
+    {
+        // Keep the newest ones, the oldest would be played first anyway
+        if (0 == position)
+        {
+            stats.overflow++;
+            return false;
+        }
+        for (size_t i = 1; i < position; i++) {samples[i - 1] = samples[i];}
+        position--;
+        count--;
+        stats.overflow++;
+    }
+    for (size_t i = count; i > position; i--) {samples[i] = samples[i - 1];}
+    samples[position] = sample;
+    count++;
+
+    const int64_t transit = static_cast<int64_t>(arrivalMs) - static_cast<int64_t>(sample.timestamp);
+    if (not hasOffset || transit < offset)
+    {
+        offset = transit;
+        hasOffset = true;
+    }
+    return true;
+}
+
+/**
+ * Computes the setpoint for the current instant.
+ *
+ * @param nowMs - local time in milliseconds since the epoch
+ * @return false until the first sample is due
+ */
+bool JitterBuffer::playout(uint64_t nowMs, Setpoint &setpoint)
+{
+    if (not hasOffset) {return false;}
+    const int64_t leaderNow = static_cast<int64_t>(nowMs) - offset - static_cast<int64_t>(delay);
+    if (leaderNow <= 0) {return false;}
+    uint64_t at = static_cast<uint64_t>(leaderNow);
+
+    // The mapping only moves backwards when a faster packet arrives, playout never does
+    if (at < lastPlayout) {at = lastPlayout;}
+
+    // Everything up to now has been played
+    size_t consumed = 0;
+    while (consumed < count && samples[consumed].timestamp <= at)
+    {
+        older = previous;
+        previous = samples[consumed];
+        pendingDistance += previous.distanceTraveled;
+        if (played < 2) {played++;}
+        consumed++;
+    }
+    if (consumed > 0)
+    {
+        for (size_t i = consumed; i < count; i++) {samples[i - consumed] = samples[i];}
+        count -= consumed;
+    }
+    if (0 == played) {return false;}
+
+    setpoint.timestamp = at;
+    setpoint.extrapolated = false;
+    if (count > 0)
+    {
+        const StatusSample &next = samples[0];
+        const float t = static_cast<float>(at - previous.timestamp)
+            / static_cast<float>(next.timestamp - previous.timestamp);
+        setpoint.speed = previous.speed + (next.speed - previous.speed) * t;
+        setpoint.steeringAngle = previous.steeringAngle
+            + (next.steeringAngle - previous.steeringAngle) * t;
+        stats.interpolated++;
+    }
+    else if (played > 1)
+    {
+        uint64_t span = at - previous.timestamp;
+        const bool held = span > maxExtrapolation;
+        if (held) {span = maxExtrapolation;}
+        const float t = static_cast<float>(span)
+            / static_cast<float>(previous.timestamp - older.timestamp);
+        setpoint.speed = previous.speed + (previous.speed - older.speed) * t;
+        setpoint.steeringAngle = previous.steeringAngle
+            + (previous.steeringAngle - older.steeringAngle) * t;
+        setpoint.extrapolated = span > 0;
+        if (held) {stats.held++;}
+        else if (setpoint.extrapolated) {stats.extrapolated++;}
+    }
+    else
+    {
+        setpoint.speed = previous.speed;
+        setpoint.steeringAngle = previous.steeringAngle;
+        stats.held++;
+    }
+    setpoint.distanceTraveled = static_cast<uint8_t>(pendingDistance > 255 ? 255 : pendingDistance);
+    pendingDistance = 0;
+
+    lastPlayout = at;
+    stats.played++;
+    return true;
+}
+
+/**
+ * @param reset - start counting from zero again
+ */
+PlayoutCounters JitterBuffer::counters(bool reset)
+{
+    const PlayoutCounters result = stats;
+    if (reset) {stats = PlayoutCounters();}
+    return result;
+}
@@ -0,0 +1,90 @@
+#ifndef V2V_PROTOCOL_DEMO_JITTERBUFFER_HPP
+#define V2V_PROTOCOL_DEMO_JITTERBUFFER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * One LeaderStatus, timestamp in milliseconds on the leader's clock.
+ */
+struct StatusSample
+{
+    uint64_t timestamp;
+    float speed;
+    float steeringAngle;
+    uint8_t distanceTraveled;
+};
+
+
+/**
+ * What the follower should do at one playout instant.
+ */
+struct Setpoint
+{
+    uint64_t timestamp;         // playout instant on the leader's clock
+    float speed;
+    float steeringAngle;
+    uint8_t distanceTraveled;   // sum over the samples played since the last setpoint
+    bool extrapolated;
+};
+
+
+/**
+ * Counters since the last reset.
+ */
+struct PlayoutCounters
+{
+    uint64_t played;            // setpoints produced
+    uint64_t interpolated;      // ... between two received samples
+    uint64_t extrapolated;      // ... dead-reckoned past the newest sample
+    uint64_t held;              // ... frozen because extrapolation ran too far
+    uint64_t stale;             // samples dropped as duplicate or already played past
+    uint64_t overflow;          // samples dropped because the buffer was full
+};
+
+
+/**
+ * Timestamp-ordered jitter buffer for LeaderStatus.
+ *
+ * Samples are kept sorted by their timestamp, so reordered packets are put
+ * back in place and packets older than what was already played are dropped.
+ * Playout runs a fixed delay behind the leader: the leader's clock is mapped
+ * to the local one through the smallest transit time seen, and the setpoint
+ * for an instant is interpolated linearly between the samples around it.
+ * When the buffer runs dry the last two samples are extrapolated for up to
+ * maxExtrapolation, after that the last value is held.
+ *
+ * Not thread-safe, the caller serializes access.
+ */
+class JitterBuffer {
+public:
+    static const size_t CAPACITY = 16;
+
+    JitterBuffer(uint32_t delayMs, uint32_t maxExtrapolationMs);
+
+    bool insert(const StatusSample &sample, uint64_t arrivalMs);
+    bool playout(uint64_t nowMs, Setpoint &setpoint);
+    void reset();
+    PlayoutCounters counters(bool reset);
+
+private:
+    const uint32_t delay;
+    const uint32_t maxExtrapolation;
+
+    StatusSample samples[CAPACITY];     // not yet played, ascending timestamps
+    size_t count;
+
+    // The two newest samples already played past, for interpolation and dead reckoning
+    StatusSample previous;
+    StatusSample older;
+    uint8_t played;
+    uint32_t pendingDistance;
+
+    int64_t offset;                     // local minus leader clock, plus the smallest transit
+    bool hasOffset;
+    uint64_t lastPlayout;
+    PlayoutCounters stats;
+};
+
+#endif //V2V_PROTOCOL_DEMO_JITTERBUFFER_HPP
@@ -0,0 +1,66 @@
+#ifndef V2V_PROTOCOL_DEMO_MESSAGEFIELDS_HPP
+#define V2V_PROTOCOL_DEMO_MESSAGEFIELDS_HPP
+
+#include <cstdint>
+#include <string>
+#include "Messages.hpp"
+
+
+/**
+ * Visits the fields of a message with WireWriter or WireReader, in the
+ * order and with the IDs of its generated accept().
+ *
+ * accept() builds std::string type and field names for every field it
+ * visits. Names that do not fit the small string buffer, such as
+ * "distanceTraveled" or "CompactLeaderStatus", cost a heap allocation per
+ * message. The statuses sent many times a second are therefore visited
+ * field by field without names. Every other message goes through accept().
+ * preVisit() and postVisit() are skipped; neither visitor needs them.
+ */
+template <class T, class Visitor>
+void visitFields(T &msg, Visitor &visitor)
+{
+    msg.accept(visitor);
+}
+
+template <class Visitor>
+void visitFields(LeaderStatus &msg, Visitor &visitor)
+{
+    uint64_t timestamp = msg.timestamp();
+    float speed = msg.speed();
+    float steeringAngle = msg.steeringAngle();
+    uint8_t distanceTraveled = msg.distanceTraveled();
+    uint32_t sequence = msg.sequence();
+    visitor.visit(1, std::string(), std::string(), timestamp);
+    visitor.visit(2, std::string(), std::string(), speed);
+    visitor.visit(3, std::string(), std::string(), steeringAngle);
+    visitor.visit(4, std::string(), std::string(), distanceTraveled);
+    visitor.visit(5, std::string(), std::string(), sequence);
+    msg.timestamp(timestamp);
+    msg.speed(speed);
+    msg.steeringAngle(steeringAngle);
+    msg.distanceTraveled(distanceTraveled);
+    msg.sequence(sequence);
+}
+
+template <class Visitor>
+void visitFields(CompactLeaderStatus &msg, Visitor &visitor)
+{
+    uint32_t sequence = msg.sequence();
+    uint32_t timestamp = msg.timestamp();
+    int32_t speed = msg.speed();
+    int32_t steeringAngle = msg.steeringAngle();
+    uint8_t distanceTraveled = msg.distanceTraveled();
+    visitor.visit(1, std::string(), std::string(), sequence);
+    visitor.visit(2, std::string(), std::string(), timestamp);
+    visitor.visit(3, std::string(), std::string(), speed);
+    visitor.visit(4, std::string(), std::string(), steeringAngle);
+    visitor.visit(5, std::string(), std::string(), distanceTraveled);
+    msg.sequence(sequence);
+    msg.timestamp(timestamp);
+    msg.speed(speed);
+    msg.steeringAngle(steeringAngle);
+    msg.distanceTraveled(distanceTraveled);
+}
+
+#endif //V2V_PROTOCOL_DEMO_MESSAGEFIELDS_HPP
@@ -0,0 +1,193 @@
+#ifndef V2V_PROTOCOL_DEMO_MESSAGEREGISTRY_HPP
+#define V2V_PROTOCOL_DEMO_MESSAGEREGISTRY_HPP
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <initializer_list>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include "MessageFields.hpp"
+#include "WireCodec.hpp"
+
+
+/**
+ * A message type of Messages.hpp together with its ID. cluon-msc does not
+ * generate ID() as constexpr, so the ID is given next to the type.
+ *
+ * @tparam Id - message ID, as in Messages.odvd
+ * @tparam T - generated message class
+ */
+template <int32_t Id, class T>
+struct Message
+{
+    static constexpr int32_t ID = Id;
+    typedef T Type;
+};
+
+
+/** What became of a dispatched frame */
+enum class Dispatch
+{
+    HANDLED,        // decoded and handed to its handler
+    UNHANDLED,      // known type without a handler, the payload was not decoded
+    UNKNOWN         // ID not in the registry, rejected on the header alone
+};
+
+
+/** Position of each ID in a registry plus one, 0 where no type is registered */
+template <size_t SPAN>
+struct IdLookup
+{
+    uint8_t position[SPAN];
+};
+
+constexpr int32_t lowestId(std::initializer_list<int32_t> ids)
+{
+    int32_t lowest = *ids.begin();
+    for (int32_t id : ids) {lowest = id < lowest ? id : lowest;}
+    return lowest;
+}
+
+constexpr int32_t highestId(std::initializer_list<int32_t> ids)
+{
+    int32_t highest = *ids.begin();
+    for (int32_t id : ids) {highest = id > highest ? id : highest;}
+    return highest;
+}
+
+constexpr bool uniqueIds(std::initializer_list<int32_t> ids)
+{
+    for (const int32_t *i = ids.begin(); i != ids.end(); i++)
+    {
+        for (const int32_t *j = i + 1; j != ids.end(); j++)
+        {
+            if (*i == *j) {return false;}
+        }
+    }
+    return true;
+}
+
+template <size_t SPAN>
+constexpr IdLookup<SPAN> idLookup(std::initializer_list<int32_t> ids, int32_t lowest)
+{
+    IdLookup<SPAN> lookup{};
+    uint8_t position = 0;
+    for (int32_t id : ids) {lookup.position[id - lowest] = ++position;}
+    return lookup;
+}
+
+
+/**
+ * Compile-time table from message ID to typed handler.
+ *
+ * The IDs of all registered types are turned into a lookup table at compile
+ * time, indexed by ID minus the lowest ID, so finding the type of a frame is
+ * one bounds check and one load. Each type has a slot for a member function
+ * of the owner; a frame is decoded into its type only if that slot is set.
+ *
+ * @tparam Owner - class whose member functions handle the messages
+ * @tparam Context - what the handlers get besides the message, e.g. the sender
+ * @tparam Messages - Message<Id, T> for every type that can arrive
+ */
+template <class Owner, class Context, class... Messages>
+class MessageRegistry {
+    static_assert(sizeof...(Messages) > 0, "Register at least one message type");
+    static_assert(sizeof...(Messages) < 255, "Too many message types for an 8 bit index");
+
+    static_assert(uniqueIds({Messages::ID...}), "Message IDs must be unique");
+    static_assert(lowestId({Messages::ID...}) >= 0 && highestId({Messages::ID...}) <= 0x7FFF,
+                  "Message IDs must fit the wire header");
+
+    static constexpr int32_t LOWEST = lowestId({Messages::ID...});
+    static constexpr size_t SPAN = static_cast<size_t>(highestId({Messages::ID...}) - LOWEST) + 1;
+    static constexpr IdLookup<SPAN> lookup = idLookup<SPAN>({Messages::ID...}, LOWEST);
+
+public:
+    template <class T>
+    using Handler = void (Owner::*)(T &msg, const Context &context);
+
+    MessageRegistry() : handlers() {}
+
+    /**
+     * Sets the handler of a type, which must be one of Messages.
+     */
+    template <class T>
+    void on(Handler<T> handler) noexcept
+    {
+        std::get<Handler<T>>(handlers) = handler;
+    }
+
+    /**
+     * @return true if id belongs to a registered type, handled or not
+     */
+    static bool known(int32_t id) noexcept
+    {
+        return position(id) > 0;
+    }
+
+    /**
+     * Decodes a frame into its type and calls the handler of that type.
+     *
+     * @param owner - object to call the handler on
+     * @param frame - extracted frame
+     * @param context - passed on to the handler
+     * @return what became of the frame
+     */
+    Dispatch dispatch(Owner &owner, const WireFrame &frame, const Context &context)
+    {
+        const size_t at = position(frame.id);
+        if (0 == at) {return Dispatch::UNKNOWN;}
+        return thunks[at - 1](owner, handlers, frame, context);
+    }
+
+private:
+    typedef std::tuple<Handler<typename Messages::Type>...> Handlers;
+    typedef Dispatch (*Thunk)(Owner &owner, Handlers &handlers, const WireFrame &frame,
+                              const Context &context);
+
+    Handlers handlers;
+
+    static size_t position(int32_t id) noexcept
+    {
+        const int32_t offset = id - LOWEST;
+        return offset < 0 || static_cast<size_t>(offset) >= SPAN
+            ? 0 : lookup.position[offset];
+    }
+
+    template <size_t I>
+    static Dispatch invoke(Owner &owner, Handlers &handlers, const WireFrame &frame,
+                           const Context &context)
+    {
+        typedef typename std::tuple_element<I, std::tuple<typename Messages::Type...>>::type T;
+        const Handler<T> handler = std::get<I>(handlers);
+        if (nullptr == handler) {return Dispatch::UNHANDLED;}
+
+        WireReader reader(frame.payload, frame.length);
+        T msg = T();
+        visitFields(msg, reader);
+        (owner.*handler)(msg, context);
+        return Dispatch::HANDLED;
+    }
+
+    template <size_t... I>
+    static constexpr std::array<Thunk, sizeof...(Messages)> table(std::index_sequence<I...>)
+    {
+        return {{&invoke<I>...}};
+    }
+
+    // Defined below, where the class is complete
+    static const std::array<Thunk, sizeof...(Messages)> thunks;
+};
+
+template <class Owner, class Context, class... Messages>
+constexpr IdLookup<MessageRegistry<Owner, Context, Messages...>::SPAN>
+    MessageRegistry<Owner, Context, Messages...>::lookup;
+
+template <class Owner, class Context, class... Messages>
+const std::array<typename MessageRegistry<Owner, Context, Messages...>::Thunk, sizeof...(Messages)>
+    MessageRegistry<Owner, Context, Messages...>::thunks =
+        MessageRegistry<Owner, Context, Messages...>::table(std::index_sequence_for<Messages...>());
+
+#endif //V2V_PROTOCOL_DEMO_MESSAGEREGISTRY_HPP
@@ -0,0 +1,167 @@
+// Vera requires this "Copyright" notice
+
+#include "MirrorStage.hpp"
+
+#include <chrono>
+
+MirrorStage::MirrorStage()
+    : defaultPeriod(0), running(false)
+{
+    for (Slot &slot : slots)
+    {
+        slot.id.store(0, std::memory_order_relaxed);
+        slot.busy.clear(std::memory_order_relaxed);
+        slot.pending.store(false, std::memory_order_relaxed);
+        slot.period.store(0, std::memory_order_relaxed);
+        slot.posted.store(0, std::memory_order_relaxed);
+        slot.sent.store(0, std::memory_order_relaxed);
+        slot.lastSent = 0;
+        slot.sampleTime = 0;
+        slot.length = 0;
+    }
+}
+
+MirrorStage::~MirrorStage()
+{
+    stop();
+}
+
+/**
+ * Starts the background thread.
+ *
+ * @param sink - called on the background thread for every payload sent
+ */
+void MirrorStage::start(Sink sink)
+{
+    if (running.load()) {return;}
+    this->sink = std::move(sink);
+    running.store(true);
+    drainThread = std::thread(&MirrorStage::drain, this);
+}
+
+/**
+ * Stops the background thread, payloads still waiting are discarded.
+ */
+void MirrorStage::stop()
+{
+    running.store(false);
+    if (drainThread.joinable()) {drainThread.join();}
+}
+
+/**
+ * Sets the sampling rate of every type without a rate of its own.
+ *
+ * @param hz - payloads per second, 0 passes on the latest one every TICK
+ */
+void MirrorStage::rate(float hz)
+{
+    const uint32_t period = periodOf(hz);
+    const uint32_t previous = defaultPeriod.exchange(period);
+    for (Slot &slot : slots)
+    {
+        uint32_t expected = previous;
+        slot.period.compare_exchange_strong(expected, period);
+    }
+}
+
+/**
+ * Sets the sampling rate of one message type.
+ *
+ * @param hz - payloads per second, 0 passes on the latest one every TICK
+ */
+void MirrorStage::rate(int32_t id, float hz)
+{
+    Slot *slot = slotOf(id);
+    if (nullptr != slot) {slot->period.store(periodOf(hz));}
+}
+
+/**
+ * @param out - receives one entry per message type seen
+ * @param reset - start counting from zero again
+ * @return number of entries written
+ */
+size_t MirrorStage::counters(TypeCounters *out, size_t max, bool reset)
+{
+    size_t n = 0;
+    for (Slot &slot : slots)
+    {
+        const int32_t id = slot.id.load(std::memory_order_acquire);
+        if (0 == id || n == max) {continue;}
+        out[n].id = id;
+        out[n].posted = reset ? slot.posted.exchange(0) : slot.posted.load();
+        out[n].sent = reset ? slot.sent.exchange(0) : slot.sent.load();
+        n++;
+    }
+    return n;
+}
+
+/**
+ * @return the slot of a message type, claimed on first use; null once all are taken
+ */
+MirrorStage::Slot *MirrorStage::slotOf(int32_t id) noexcept
+{
+    const size_t home = static_cast<uint32_t>(id) % MAX_TYPES;
+    for (size_t i = 0; i < MAX_TYPES; i++)
+    {
+        Slot &slot = slots[(home + i) % MAX_TYPES];
+        int32_t current = slot.id.load(std::memory_order_acquire);
+        if (current == id) {return &slot;}
+        if (0 == current)
+        {
+            slot.period.store(defaultPeriod.load(std::memory_order_relaxed),
+                std::memory_order_relaxed);
+            if (slot.id.compare_exchange_strong(current, id, std::memory_order_acq_rel)
+                || current == id)
+            {
+                return &slot;
+            }
+        }
+    }
+    return nullptr;
+}
+
+/**
+ * Background thread: every TICK passes on the waiting payloads whose
+ * sampling period is over.
+ */
+void MirrorStage::drain()
+{
+    std::string payload;
+    payload.reserve(MAX_FRAME_SIZE);
+    while (running.load(std::memory_order_acquire))
+    {
+        const uint64_t tick = static_cast<uint64_t>(now());
+        for (Slot &slot : slots)
+        {
+            const int32_t id = slot.id.load(std::memory_order_acquire);
+            if (0 == id || not slot.pending.load(std::memory_order_relaxed)) {continue;}
+            if (tick - slot.lastSent < slot.period.load(std::memory_order_relaxed)) {continue;}
+
+            // Writers hold the slot only while encoding one message
+            while (slot.busy.test_and_set(std::memory_order_acquire)) {std::this_thread::yield();}
+            payload.assign(slot.payload, slot.length);
+            const int64_t sampleTime = slot.sampleTime;
+            slot.pending.store(false, std::memory_order_relaxed);
+            slot.busy.clear(std::memory_order_release);
+
+            sink(id, payload, sampleTime);
+            slot.sent.fetch_add(1, std::memory_order_relaxed);
+            slot.lastSent = tick;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(TICK));
+    }
+}
+
+/**
+ * @return microseconds since the epoch, as used by envelope time stamps
+ */
+int64_t MirrorStage::now() noexcept
+{
+    using namespace std::chrono;
+    return duration_cast<microseconds>(system_clock::now().time_since_epoch()).count();
+}
+
+uint32_t MirrorStage::periodOf(float hz) noexcept
+{
+    return hz > 0.0f ? static_cast<uint32_t>(1e6f / hz) : 0;
+}
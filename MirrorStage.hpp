@@ -0,0 +1,99 @@
+#ifndef V2V_PROTOCOL_DEMO_MIRRORSTAGE_HPP
+#define V2V_PROTOCOL_DEMO_MIRRORSTAGE_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <thread>
+#include "MessageFields.hpp"
+#include "WireCodec.hpp"
+
+
+/**
+ * Copies of protocol messages on their way to the visualization channel.
+ *
+ * Protocol threads post a message by encoding it into the slot of its type,
+ * overwriting whatever is still waiting there, so only the latest message of
+ * each type is kept and the others are merely counted. A background thread
+ * hands the waiting payloads to the sink, at most once per sampling period of
+ * the type. Posting never blocks: if the background thread is just taking
+ * the slot, the message is dropped like any other coalesced one.
+ */
+class MirrorStage {
+public:
+    /** Receives one payload, the protobuf encoding of the message */
+    typedef std::function<void(int32_t id, const std::string &payload, int64_t sampleTime)> Sink;
+
+    struct TypeCounters
+    {
+        int32_t id;
+        uint64_t posted;
+        uint64_t sent;
+    };
+
+    static const size_t MAX_TYPES = 16;
+    static const uint32_t TICK = 5;             // milliseconds between passes over the slots
+
+    MirrorStage();
+    ~MirrorStage();
+    MirrorStage(const MirrorStage &) = delete;
+    MirrorStage &operator=(const MirrorStage &) = delete;
+
+    void start(Sink sink);
+    void stop();
+    void rate(float hz);
+    void rate(int32_t id, float hz);
+    size_t counters(TypeCounters *out, size_t max, bool reset);
+
+    /**
+     * Queues a copy of a message, a no-op until the stage is started.
+     */
+    template <class T>
+    void post(T &msg) noexcept
+    {
+        if (not running.load(std::memory_order_relaxed)) {return;}
+        Slot *slot = slotOf(msg.ID());
+        if (nullptr == slot) {return;}
+        slot->posted.fetch_add(1, std::memory_order_relaxed);
+        if (slot->busy.test_and_set(std::memory_order_acquire)) {return;}
+
+        WireWriter writer(slot->payload, sizeof(slot->payload));
+        visitFields(msg, writer);
+        if (not writer.overflow())
+        {
+            slot->length = writer.size();
+            slot->sampleTime = now();
+            slot->pending.store(true, std::memory_order_relaxed);
+        }
+        slot->busy.clear(std::memory_order_release);
+    }
+
+private:
+    struct Slot
+    {
+        std::atomic<int32_t> id;                // 0 while the slot is free
+        std::atomic_flag busy;
+        std::atomic<bool> pending;
+        std::atomic<uint32_t> period;           // microseconds, 0 sends every pass
+        std::atomic<uint64_t> posted;
+        std::atomic<uint64_t> sent;
+        uint64_t lastSent;
+        int64_t sampleTime;
+        size_t length;
+        char payload[MAX_FRAME_SIZE];
+    };
+
+    Slot slots[MAX_TYPES];
+    std::atomic<uint32_t> defaultPeriod;
+    std::atomic<bool> running;
+    Sink sink;
+    std::thread drainThread;
+
+    Slot *slotOf(int32_t id) noexcept;
+    void drain();
+    static int64_t now() noexcept;
+    static uint32_t periodOf(float hz) noexcept;
+};
+
+#endif //V2V_PROTOCOL_DEMO_MIRRORSTAGE_HPP
@@ -0,0 +1,61 @@
+// Vera requires this "Copyright" notice
+
+#include "PeerPool.hpp"
+#include "BatchSender.hpp"
+
+#include <algorithm>
+
+/**
+ * @param port - V2V port of every peer
+ * @param capacity - peers kept at most
+ */
+PeerPool::PeerPool(uint16_t port, size_t capacity)
+    : port(port), capacity(capacity > 0 ? capacity : 1), lookups(0), stats()
+{
+    peers.reserve(this->capacity);
+}
+
+/**
+ * Gets the endpoint of a peer, resolving it the first time.
+ *
+ * @param vehicleIp - IPv4 address of the peer
+ * @param address - endpoint of the peer
+ * @return false if the IP is empty or not an IPv4 address, nothing should be sent then
+ */
+bool PeerPool::address(std::string_view vehicleIp, sockaddr_in &address)
+{
+    lookups++;
+    auto at = std::lower_bound(peers.begin(), peers.end(), vehicleIp,
+        [](const Peer &peer, std::string_view key) { return peer.ip < key; });
+    if (at != peers.end() && at->ip == vehicleIp)
+    {
+        at->lastUsed = lookups;
+        address = at->address;
+        stats.hits++;
+        return true;
+    }
+
+    // inet_pton(3) wants a terminated string, only misses pay for the copy
+    Peer peer;
+    peer.ip = vehicleIp;
+    if (vehicleIp.empty() || not BatchSender::resolve(peer.ip, port, peer.address))
+    {
+        stats.rejected++;
+        return false;
+    }
+    peer.lastUsed = lookups;
+    address = peer.address;
+    stats.resolved++;
+
+    size_t position = static_cast<size_t>(at - peers.begin());
+    if (peers.size() >= capacity)
+    {
+        auto oldest = std::min_element(peers.begin(), peers.end(),
+            [](const Peer &a, const Peer &b) { return a.lastUsed < b.lastUsed; });
+        if (oldest < at) {position--;}
+        peers.erase(oldest);
+        stats.evicted++;
+    }
+    peers.insert(peers.begin() + static_cast<ptrdiff_t>(position), std::move(peer));
+    return true;
+}
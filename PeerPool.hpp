@@ -0,0 +1,58 @@
+#ifndef V2V_PROTOCOL_DEMO_PEERPOOL_HPP
+#define V2V_PROTOCOL_DEMO_PEERPOOL_HPP
+
+#include <netinet/in.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+/**
+ * Counters since the pool was created.
+ */
+struct PeerPoolCounters
+{
+    uint64_t hits;              // lookups answered from the pool
+    uint64_t resolved;          // peers parsed and added
+    uint64_t rejected;          // lookups of an empty or unparsable IP
+    uint64_t evicted;           // peers dropped to make room
+};
+
+
+/**
+ * Resolved V2V endpoints of the peers a car paired with, keyed by IP.
+ *
+ * A car that pairs, leaves and pairs again is looked up instead of parsed
+ * again, and IPs that cannot be sent to are refused before anything goes
+ * out. Peers are kept sorted by IP; when the pool is full the one unused
+ * the longest makes room.
+ *
+ * Not thread-safe, the caller serializes access.
+ */
+class PeerPool {
+public:
+    PeerPool(uint16_t port, size_t capacity);
+
+    bool address(std::string_view vehicleIp, sockaddr_in &address);
+
+    size_t size() const { return peers.size(); }
+    const PeerPoolCounters &counters() const { return stats; }
+
+private:
+    struct Peer
+    {
+        std::string ip;
+        sockaddr_in address;
+        uint64_t lastUsed;      // lookup count when it was last used
+    };
+
+    const uint16_t port;
+    const size_t capacity;
+    std::vector<Peer> peers;    // sorted by ip
+    uint64_t lookups;
+    PeerPoolCounters stats;
+};
+
+#endif //V2V_PROTOCOL_DEMO_PEERPOOL_HPP
@@ -0,0 +1,322 @@
+// Vera requires this "Copyright" notice
+
+#include "PresenceTable.hpp"
+
+#include <cstring>
+
+/**
+ * @param capacity - cars tracked at most, rounded up so the table stays at most 3/4 full
+ * @param ttlMicros - time after its last announcement a car is considered gone
+ */
+PresenceTable::PresenceTable(size_t capacity, uint64_t ttlMicros)
+    : mask(0), count(0), maxCount(capacity), ttl(ttlMicros), rejected(0), groupMask(0),
+      groupCount(0)
+{
+    size_t slots = 8;
+    while (slots * 3 / 4 < capacity) {slots <<= 1;}
+    entries.resize(slots);
+    for (Entry &entry : entries) {entry.used = false;}
+    mask = slots - 1;
+
+    // Every group has a live car, so there are never more groups than cars
+    groups.resize(slots);
+    for (Group &group : groups) {group.used = false;}
+    groupMask = slots - 1;
+}
+
+/**
+ * Records an announcement, inserting the car or refreshing its entry.
+ *
+ * @return false if the IP or group ID is too long or the table is full of live cars
+ */
+bool PresenceTable::update(std::string_view vehicleIp, std::string_view groupId, uint64_t now)
+{
+    if (vehicleIp.empty() || vehicleIp.length() >= IP_SIZE || groupId.length() >= GROUP_SIZE)
+    {
+        rejected++;
+        return false;
+    }
+
+    const uint32_t hash = hashOf(vehicleIp);
+    evictChain(hash, now);
+    size_t slot = slotOf(vehicleIp, hash);
+    if (not entries[slot].used)
+    {
+        if (count >= maxCount)
+        {
+            // Make room from cars that went quiet before refusing a new one
+            if (0 == evict(now))
+            {
+                rejected++;
+                return false;
+            }
+            slot = slotOf(vehicleIp, hash);
+        }
+        Entry &entry = entries[slot];
+        entry.used = true;
+        entry.hash = hash;
+        entry.ipLength = static_cast<uint8_t>(vehicleIp.length());
+        std::memcpy(entry.ip, vehicleIp.data(), vehicleIp.length());
+        count++;
+    }
+    else if (entries[slot].groupLength != groupId.length()
+        || 0 != std::memcmp(entries[slot].group, groupId.data(), groupId.length()))
+    {
+        leaving(entries[slot]);
+    }
+
+    Entry &entry = entries[slot];
+    entry.groupLength = static_cast<uint8_t>(groupId.length());
+    std::memcpy(entry.group, groupId.data(), groupId.length());
+    entry.lastSeen = now;
+    newest(entry);
+    return true;
+}
+
+/**
+ * @param lastSeen - receives the time of the last announcement when not null
+ * @return true if the car announced itself within the TTL
+ */
+bool PresenceTable::find(std::string_view vehicleIp, uint64_t now, uint64_t *lastSeen) const
+{
+    const Entry &entry = entries[slotOf(vehicleIp, hashOf(vehicleIp))];
+    if (not entry.used || expired(entry.lastSeen, now)) {return false;}
+    if (nullptr != lastSeen) {*lastSeen = entry.lastSeen;}
+    return true;
+}
+
+/**
+ * Removes a car until it announces itself again.
+ *
+ * @return false if the car was not in the table
+ */
+bool PresenceTable::forget(std::string_view vehicleIp)
+{
+    const size_t slot = slotOf(vehicleIp, hashOf(vehicleIp));
+    if (not entries[slot].used) {return false;}
+    leaving(entries[slot]);
+    erase(slot);
+    return true;
+}
+
+/**
+ * Removes every car whose last announcement is older than the TTL.
+ *
+ * @return number of cars removed
+ */
+size_t PresenceTable::evict(uint64_t now)
+{
+    size_t evicted = 0;
+    for (size_t slot = 0; slot <= mask; slot++)
+    {
+        // erase() may shift the next entry of the chain into this slot
+        while (entries[slot].used && expired(entries[slot].lastSeen, now))
+        {
+            erase(slot);
+            evicted++;
+        }
+    }
+    return evicted;
+}
+
+/**
+ * Picks the car to follow in a group: the live one that announced itself last.
+ *
+ * @param vehicleIp - receives the IP, its storage is reused between calls
+ * @return false if no live car of the group is known
+ */
+bool PresenceTable::leader(std::string_view groupId, uint64_t now, std::string &vehicleIp)
+{
+    if (groupId.length() >= GROUP_SIZE) {return false;}
+    const size_t slot = groupSlotOf(groupId, hashOf(groupId));
+    Group &group = groups[slot];
+    if (not group.used) {return false;}
+    if (group.stale) {rebuild(group, now);}
+    // The newest car went quiet, so did every other car of the group
+    if (0 == group.ipLength || expired(group.lastSeen, now))
+    {
+        shiftBack(groups, groupMask, slot);
+        groupCount--;
+        return false;
+    }
+    vehicleIp.assign(group.ip, group.ipLength);
+    return true;
+}
+
+/**
+ * FNV-1a, good enough for short dotted addresses and cheap to compute.
+ */
+uint32_t PresenceTable::hashOf(std::string_view key)
+{
+    uint32_t hash = 2166136261u;
+    for (const char c : key)
+    {
+        hash ^= static_cast<uint8_t>(c);
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+bool PresenceTable::expired(uint64_t lastSeen, uint64_t now) const
+{
+    return now > lastSeen && now - lastSeen > ttl;
+}
+
+/**
+ * @return the slot holding the car, or the free slot ending its probe chain
+ */
+size_t PresenceTable::slotOf(std::string_view vehicleIp, uint32_t hash) const
+{
+    size_t slot = hash & mask;
+    while (entries[slot].used)
+    {
+        const Entry &entry = entries[slot];
+        if (entry.hash == hash && entry.ipLength == vehicleIp.length()
+            && 0 == std::memcmp(entry.ip, vehicleIp.data(), entry.ipLength))
+        {
+            break;
+        }
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+/**
+ * @return the slot holding the group, or the free slot ending its probe chain
+ */
+size_t PresenceTable::groupSlotOf(std::string_view groupId, uint32_t hash) const
+{
+    size_t slot = hash & groupMask;
+    while (groups[slot].used)
+    {
+        const Group &group = groups[slot];
+        if (group.hash == hash && group.groupLength == groupId.length()
+            && 0 == std::memcmp(group.group, groupId.data(), group.groupLength))
+        {
+            break;
+        }
+        slot = (slot + 1) & groupMask;
+    }
+    return slot;
+}
+
+/**
+ * Removes the cars past their TTL from the probe chain starting at the home
+ * slot of hash, so quiet cars leave on the way instead of in a sweep.
+ */
+void PresenceTable::evictChain(uint32_t hash, uint64_t now)
+{
+    size_t slot = hash & mask;
+    while (entries[slot].used)
+    {
+        // erase() may shift the next entry of the chain into this slot
+        if (expired(entries[slot].lastSeen, now)) {erase(slot);}
+        else {slot = (slot + 1) & mask;}
+    }
+}
+
+void PresenceTable::erase(size_t slot)
+{
+    shiftBack(entries, mask, slot);
+    count--;
+}
+
+/**
+ * Makes a car that just announced itself the newest of its group.
+ */
+void PresenceTable::newest(const Entry &entry)
+{
+    const std::string_view groupId(entry.group, entry.groupLength);
+    const uint32_t hash = hashOf(groupId);
+    size_t slot = groupSlotOf(groupId, hash);
+    if (not groups[slot].used)
+    {
+        if (groupCount >= maxCount)
+        {
+            // Groups without a live car go, which leaves at most one per car
+            for (size_t i = 0; i <= groupMask; i++)
+            {
+                while (groups[i].used)
+                {
+                    if (groups[i].stale) {rebuild(groups[i], entry.lastSeen);}
+                    if (0 != groups[i].ipLength && not expired(groups[i].lastSeen, entry.lastSeen)) {break;}
+                    shiftBack(groups, groupMask, i);
+                    groupCount--;
+                }
+            }
+            slot = groupSlotOf(groupId, hash);
+        }
+        Group &group = groups[slot];
+        group.used = true;
+        group.hash = hash;
+        group.groupLength = entry.groupLength;
+        std::memcpy(group.group, entry.group, entry.groupLength);
+        groupCount++;
+    }
+    Group &group = groups[slot];
+    group.stale = false;
+    group.ipLength = entry.ipLength;
+    std::memcpy(group.ip, entry.ip, entry.ipLength);
+    group.lastSeen = entry.lastSeen;
+}
+
+/**
+ * Called before a car is forgotten or moves to another group: if it was the
+ * newest of its old group, the group has to be looked up again.
+ */
+void PresenceTable::leaving(const Entry &entry)
+{
+    const std::string_view groupId(entry.group, entry.groupLength);
+    Group &group = groups[groupSlotOf(groupId, hashOf(groupId))];
+    if (group.used && group.ipLength == entry.ipLength
+        && 0 == std::memcmp(group.ip, entry.ip, entry.ipLength))
+    {
+        group.stale = true;
+    }
+}
+
+/**
+ * Finds the newest live car of a group in the whole table, an empty IP if there is none.
+ */
+void PresenceTable::rebuild(Group &group, uint64_t now)
+{
+    const Entry *best = nullptr;
+    for (const Entry &entry : entries)
+    {
+        if (not entry.used || expired(entry.lastSeen, now)) {continue;}
+        if (entry.groupLength != group.groupLength
+            || 0 != std::memcmp(entry.group, group.group, entry.groupLength))
+        {
+            continue;
+        }
+        if (nullptr == best || entry.lastSeen > best->lastSeen) {best = &entry;}
+    }
+    group.stale = false;
+    group.ipLength = nullptr == best ? 0 : best->ipLength;
+    if (nullptr == best) {return;}
+    std::memcpy(group.ip, best->ip, best->ipLength);
+    group.lastSeen = best->lastSeen;
+}
+
+/**
+ * Backward-shift deletion: moves later entries of the probe chain into the
+ * hole unless that would put them before their home slot.
+ */
+template <class T>
+void PresenceTable::shiftBack(std::vector<T> &table, size_t tableMask, size_t slot)
+{
+    size_t hole = slot;
+    size_t next = slot;
+    for (;;)
+    {
+        next = (next + 1) & tableMask;
+        if (not table[next].used) {break;}
+        const size_t home = table[next].hash & tableMask;
+        const bool stays = hole <= next ? (hole < home && home <= next)
+                                        : (hole < home || home <= next);
+        if (stays) {continue;}
+        table[hole] = table[next];
+        hole = next;
+    }
+    table[hole].used = false;
+}
@@ -0,0 +1,94 @@
+#ifndef V2V_PROTOCOL_DEMO_PRESENCETABLE_HPP
+#define V2V_PROTOCOL_DEMO_PRESENCETABLE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+
+/**
+ * Cars heard on the broadcast channel, keyed by vehicle IP.
+ *
+ * Open addressing with linear probing over a power-of-two array that is
+ * allocated once, so lookups and updates are O(1) and never allocate. Keys
+ * and group IDs are stored inline. Removal shifts the following entries back
+ * instead of leaving tombstones, so probe chains stay short however often
+ * cars come and go.
+ *
+ * A second table keeps the car that announced itself last in each group,
+ * so picking a leader is O(1) as well. Only when that car is forgotten or
+ * changes its group is the group looked up once in the whole table.
+ *
+ * Entries not refreshed within the TTL are ignored by queries. update()
+ * removes those on the probe chain it walks, a full sweep by evict() only
+ * runs when the table is full.
+ */
+class PresenceTable {
+public:
+    static const size_t IP_SIZE = 40;       // longest textual IPv6 address plus NUL
+    static const size_t GROUP_SIZE = 16;
+
+    PresenceTable(size_t capacity, uint64_t ttlMicros);
+
+    bool update(std::string_view vehicleIp, std::string_view groupId, uint64_t now);
+    bool find(std::string_view vehicleIp, uint64_t now, uint64_t *lastSeen = nullptr) const;
+    bool forget(std::string_view vehicleIp);
+    size_t evict(uint64_t now);
+    bool leader(std::string_view groupId, uint64_t now, std::string &vehicleIp);
+
+    size_t size() const { return count; }
+    uint64_t overflows() const { return rejected; }
+
+private:
+    struct Entry
+    {
+        uint32_t hash;
+        bool used;
+        uint8_t ipLength;
+        uint8_t groupLength;
+        uint64_t lastSeen;      // monotonic microseconds
+        char ip[IP_SIZE];
+        char group[GROUP_SIZE];
+    };
+
+    /** Newest car of a group, keyed by group ID */
+    struct Group
+    {
+        uint32_t hash;
+        bool used;
+        bool stale;             // the newest car left, the group has to be looked up again
+        uint8_t groupLength;
+        uint8_t ipLength;
+        uint64_t lastSeen;      // of the newest car, monotonic microseconds
+        char group[GROUP_SIZE];
+        char ip[IP_SIZE];
+    };
+
+    std::vector<Entry> entries;
+    size_t mask;
+    size_t count;
+    size_t maxCount;
+    uint64_t ttl;
+    uint64_t rejected;
+
+    std::vector<Group> groups;
+    size_t groupMask;
+    size_t groupCount;
+
+    static uint32_t hashOf(std::string_view key);
+    bool expired(uint64_t lastSeen, uint64_t now) const;
+    size_t slotOf(std::string_view vehicleIp, uint32_t hash) const;
+    size_t groupSlotOf(std::string_view groupId, uint32_t hash) const;
+    void evictChain(uint32_t hash, uint64_t now);
+    void erase(size_t slot);
+    void newest(const Entry &entry);
+    void leaving(const Entry &entry);
+    void rebuild(Group &group, uint64_t now);
+
+    template <class T>
+    static void shiftBack(std::vector<T> &table, size_t tableMask, size_t slot);
+};
+
+#endif //V2V_PROTOCOL_DEMO_PRESENCETABLE_HPP
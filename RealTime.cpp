@@ -0,0 +1,45 @@
+// Vera requires this "Copyright" notice
+
+#include "RealTime.hpp"
+
+#include <sched.h>
+#include <sys/mman.h>
+
+/**
+ * Pins a thread to a CPU and moves it to SCHED_FIFO, as the policy says.
+ * Both need privileges (CAP_SYS_NICE) the process may not have, a thread
+ * that could not be changed keeps running as it did.
+ *
+ * @param thread - thread to change
+ * @param policy - CPU and priority, defaults are left alone
+ * @return false if the affinity or the priority could not be set
+ */
+bool applyThreadPolicy(pthread_t thread, const ThreadPolicy &policy)
+{
+    bool applied = true;
+    if (policy.cpu >= 0)
+    {
+        cpu_set_t cpus;
+        CPU_ZERO(&cpus);
+        CPU_SET(policy.cpu, &cpus);
+        applied = 0 == ::pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+    }
+    if (policy.priority > 0)
+    {
+        sched_param parameters;
+        parameters.sched_priority = policy.priority;
+        applied = 0 == ::pthread_setschedparam(thread, SCHED_FIFO, &parameters) && applied;
+    }
+    return applied;
+}
+
+/**
+ * Locks the pages of the process in memory, now and as it grows, so the
+ * timer and receive threads never wait for a page fault to be served from disk.
+ *
+ * @return false if the memory could not be locked, e.g. above RLIMIT_MEMLOCK
+ */
+bool lockMemory()
+{
+    return 0 == ::mlockall(MCL_CURRENT | MCL_FUTURE);
+}
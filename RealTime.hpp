@@ -0,0 +1,22 @@
+#ifndef V2V_PROTOCOL_DEMO_REALTIME_HPP
+#define V2V_PROTOCOL_DEMO_REALTIME_HPP
+
+#include <pthread.h>
+
+
+/**
+ * CPU and scheduling class of a thread. The defaults leave the thread as the
+ * kernel started it.
+ */
+struct ThreadPolicy
+{
+    int cpu = -1;               // CPU the thread is pinned to, -1 any
+    int priority = 0;           // SCHED_FIFO priority 1 to 99, 0 keeps SCHED_OTHER
+
+    bool isDefault() const { return cpu < 0 && 0 == priority; }
+};
+
+bool applyThreadPolicy(pthread_t thread, const ThreadPolicy &policy);
+bool lockMemory();
+
+#endif //V2V_PROTOCOL_DEMO_REALTIME_HPP
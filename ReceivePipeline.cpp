@@ -0,0 +1,318 @@
+// Vera requires this "Copyright" notice
+
+#include "ReceivePipeline.hpp"
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <future>
+
+ReceivePipeline::ReceivePipeline()
+    : socketFd(-1), state(IDLE), pending(false), receivedFrames(0), droppedFrames(0),
+      receiveCalls(0)
+{
+    // The task lists are swapped between poster and worker, both keep room for a burst
+    tasks.reserve(MAX_BATCH);
+}
+
+ReceivePipeline::~ReceivePipeline()
+{
+    stop();
+}
+
+/**
+ * Starts the worker thread. Frames arrive through listen() or inject().
+ *
+ * @param handler - called on the worker thread for every datagram
+ * @return false if the pipeline was started before
+ */
+bool ReceivePipeline::start(Handler handler)
+{
+    if (IDLE != state.load()) {return false;}
+
+    this->handler = std::move(handler);
+    ring.reset(new SpscRing<ReceivedFrame, RING_SIZE>());
+    state.store(RUNNING);
+    workerThread = std::thread(&ReceivePipeline::work, this);
+    workerId = workerThread.get_id();
+    return true;
+}
+
+/**
+ * Binds the UDP port and starts the receiver thread.
+ *
+ * @param ip - local address to listen on, "0.0.0.0" for all interfaces
+ * @param port - UDP port to listen on
+ * @return false if the pipeline is not running or the socket could not be set up
+ */
+bool ReceivePipeline::listen(const std::string &ip, uint16_t port)
+{
+    if (RUNNING != state.load() || socketFd >= 0) {return false;}
+
+    sockaddr_in address;
+    std::memset(&address, 0, sizeof(address));
+    address.sin_family = AF_INET;
+    address.sin_port = htons(port);
+    if (1 != ::inet_pton(AF_INET, ip.c_str(), &address.sin_addr)) {return false;}
+
+    socketFd = ::socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, IPPROTO_UDP);
+    if (socketFd < 0) {return false;}
+    int reuse = 1;
+    ::setsockopt(socketFd, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    // Wake up regularly so stop() does not wait for traffic
+    timeval timeout;
+    timeout.tv_sec = 0;
+    timeout.tv_usec = 100000;
+    ::setsockopt(socketFd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+    if (::bind(socketFd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) < 0)
+    {
+        ::close(socketFd);
+        socketFd = -1;
+        return false;
+    }
+    receiverThread = std::thread(&ReceivePipeline::receive, this);
+    return true;
+}
+
+/**
+ * Hands a datagram to the worker as if it was received on the socket. Any
+ * thread may inject, but only while no socket is listening: the receiver
+ * thread holds ring slots across recvmmsg and must be the only producer.
+ *
+ * @param data - datagram
+ * @param length - datagram length
+ * @param from - address of the sending car
+ * @param arrival - time the datagram was received
+ * @return false if the pipeline is not running or listening, the ring is full
+ *         or the datagram too long
+ */
+bool ReceivePipeline::inject(const char *data, size_t length, const sockaddr_in &from,
+    const std::chrono::system_clock::time_point &arrival)
+{
+    if (RUNNING != state.load(std::memory_order_relaxed) || socketFd >= 0) {return false;}
+    {
+        std::lock_guard<std::mutex> lock(injectMutex);
+        if (length > MAX_FRAME_SIZE || 0 == ring->writable())
+        {
+            droppedFrames.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        ReceivedFrame &frame = ring->slot(0);
+        frame.from = from;
+        frame.arrival = arrival;
+        frame.length = length;
+        std::memcpy(frame.data, data, length);
+        ring->produce(1);
+    }
+    receivedFrames.fetch_add(1, std::memory_order_relaxed);
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = true;
+    }
+    wakeUp.notify_one();
+    return true;
+}
+
+/**
+ * Stops both threads. Frames and tasks still waiting are discarded, tasks
+ * posted afterwards are ignored.
+ */
+void ReceivePipeline::stop()
+{
+    if (RUNNING != state.exchange(STOPPED)) {return;}
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        pending = true;
+    }
+    wakeUp.notify_one();
+    if (receiverThread.joinable()) {receiverThread.join();}
+    if (workerThread.joinable()) {workerThread.join();}
+    if (socketFd >= 0) {::close(socketFd);}
+    socketFd = -1;
+}
+
+/**
+ * Pins and prioritizes the threads that are running, see applyThreadPolicy().
+ *
+ * @param receiver - policy of the receiver thread, started by listen()
+ * @param worker - policy of the worker thread, started by start()
+ * @return false if a running thread could not be changed
+ */
+bool ReceivePipeline::setThreadPolicy(const ThreadPolicy &receiver, const ThreadPolicy &worker)
+{
+    bool applied = true;
+    if (receiverThread.joinable() && not receiver.isDefault())
+    {
+        applied = applyThreadPolicy(receiverThread.native_handle(), receiver);
+    }
+    if (workerThread.joinable() && not worker.isDefault())
+    {
+        applied = applyThreadPolicy(workerThread.native_handle(), worker) && applied;
+    }
+    return applied;
+}
+
+/**
+ * Runs a task on the worker thread. Before start() the task runs right
+ * away on the calling thread, so the pipeline can be left out entirely.
+ */
+void ReceivePipeline::post(std::function<void()> task)
+{
+    const int current = state.load();
+    if (IDLE == current)
+    {
+        task();
+        return;
+    }
+    if (STOPPED == current) {return;}
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        tasks.push_back(std::move(task));
+        pending = true;
+    }
+    wakeUp.notify_one();
+}
+
+/**
+ * Runs a task on the worker thread and waits until it is done.
+ */
+void ReceivePipeline::execute(std::function<void()> task)
+{
+    if (RUNNING != state.load() || std::this_thread::get_id() == workerId)
+    {
+        post(std::move(task));
+        return;
+    }
+    // Shared with the worker, which may still hold it if stop() ends the wait
+    auto job = std::make_shared<std::packaged_task<void()>>(std::move(task));
+    std::future<void> finished = job->get_future();
+    post([job]() { (*job)(); });
+    while (std::future_status::ready != finished.wait_for(std::chrono::milliseconds(100))
+        && RUNNING == state.load()) {}
+}
+
+/**
+ * Receiver thread: reads batches of datagrams straight into the ring.
+ */
+void ReceivePipeline::receive()
+{
+    struct mmsghdr messages[MAX_BATCH];
+    struct iovec parts[MAX_BATCH];
+    std::unique_ptr<char[]> scratch(new char[MAX_BATCH * MAX_FRAME_SIZE]);
+    sockaddr_in scratchFrom[MAX_BATCH];
+
+    while (RUNNING == state.load(std::memory_order_relaxed))
+    {
+        // Read into the ring while there is room, into scratch space to drop the batch otherwise
+        const size_t room = ring->writable();
+        const bool discard = 0 == room;
+        const size_t batch = discard ? MAX_BATCH : (room < MAX_BATCH ? room : MAX_BATCH);
+        std::memset(messages, 0, sizeof(messages[0]) * batch);
+        for (size_t i = 0; i < batch; i++)
+        {
+            ReceivedFrame *frame = discard ? nullptr : &ring->slot(i);
+            parts[i].iov_base = discard ? &scratch[i * MAX_FRAME_SIZE] : frame->data;
+            parts[i].iov_len = MAX_FRAME_SIZE;
+            messages[i].msg_hdr.msg_name = discard ? &scratchFrom[i] : &frame->from;
+            messages[i].msg_hdr.msg_namelen = sizeof(sockaddr_in);
+            messages[i].msg_hdr.msg_iov = &parts[i];
+            messages[i].msg_hdr.msg_iovlen = 1;
+        }
+
+        // Blocks for the first datagram only, then takes what is already queued
+        const int result = ::recvmmsg(socketFd, messages, static_cast<unsigned int>(batch),
+            MSG_WAITFORONE, nullptr);
+        if (result <= 0) {continue;}
+        receiveCalls.fetch_add(1, std::memory_order_relaxed);
+        receivedFrames.fetch_add(static_cast<uint64_t>(result), std::memory_order_relaxed);
+        if (discard)
+        {
+            droppedFrames.fetch_add(static_cast<uint64_t>(result), std::memory_order_relaxed);
+            continue;
+        }
+
+        // Oversized datagrams cannot be valid frames, close the gaps they leave
+        const auto arrival = std::chrono::system_clock::now();
+        size_t kept = 0;
+        for (size_t i = 0; i < static_cast<size_t>(result); i++)
+        {
+            if (0 != (messages[i].msg_hdr.msg_flags & MSG_TRUNC))
+            {
+                droppedFrames.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+            if (kept != i)
+            {
+                ReceivedFrame &to = ring->slot(kept);
+                const ReceivedFrame &from = ring->slot(i);
+                to.from = from.from;
+                std::memcpy(to.data, from.data, messages[i].msg_len);
+            }
+            ring->slot(kept).length = messages[i].msg_len;
+            ring->slot(kept).arrival = arrival;
+            kept++;
+        }
+        if (0 == kept) {continue;}
+        ring->produce(kept);
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = true;
+        }
+        wakeUp.notify_one();
+    }
+}
+
+/**
+ * Worker thread: runs posted tasks and dispatches frames, sleeping while
+ * there is neither.
+ */
+void ReceivePipeline::work()
+{
+    std::vector<std::function<void()>> running;
+    running.reserve(MAX_BATCH);
+    char sender[INET_ADDRSTRLEN + 6];     // "ip:port"
+
+    while (RUNNING == state.load(std::memory_order_relaxed))
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (not pending) {wakeUp.wait(lock);}
+            pending = false;
+            running.swap(tasks);
+        }
+        if (RUNNING != state.load(std::memory_order_relaxed)) {break;}
+
+        for (auto &task : running)
+        {
+            if (RUNNING != state.load(std::memory_order_relaxed)) {break;}
+            task();
+        }
+        running.clear();
+
+        // Bounded, so tasks still get their turn under a flood of datagrams
+        size_t budget = RING_SIZE;
+        while (budget-- > 0 && ring->readable() > 0)
+        {
+            // The frame is handled in its slot and only released afterwards
+            const ReceivedFrame &frame = ring->front();
+            ::inet_ntop(AF_INET, &frame.from.sin_addr, sender, INET_ADDRSTRLEN);
+            char *end = sender + std::strlen(sender);
+            *end++ = ':';
+            end = std::to_chars(end, sender + sizeof(sender), ntohs(frame.from.sin_port)).ptr;
+            handler(std::string_view(frame.data, frame.length),
+                std::string_view(sender, static_cast<size_t>(end - sender)), frame.arrival);
+            ring->consume();
+        }
+        if (ring->readable() > 0)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            pending = true;
+        }
+    }
+}
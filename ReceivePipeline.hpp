@@ -0,0 +1,98 @@
+#ifndef V2V_PROTOCOL_DEMO_RECEIVEPIPELINE_HPP
+#define V2V_PROTOCOL_DEMO_RECEIVEPIPELINE_HPP
+
+#include <netinet/in.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include "RealTime.hpp"
+#include "SpscRing.hpp"
+#include "WireCodec.hpp"
+
+
+/**
+ * One datagram on its way from the socket to the protocol worker.
+ */
+struct ReceivedFrame
+{
+    sockaddr_in from;
+    std::chrono::system_clock::time_point arrival;
+    size_t length;
+    char data[MAX_FRAME_SIZE];
+};
+
+
+/**
+ * Receive path of the V2V port, split over two threads.
+ *
+ * The receiver thread drains the socket with recvmmsg(2), up to MAX_BATCH
+ * datagrams per call, straight into the slots of an SPSC ring. The worker
+ * thread takes frames off the ring and hands them to the handler one by one.
+ * When the ring is full, datagrams are read into a scratch batch and dropped
+ * so the socket keeps draining.
+ *
+ * The worker also runs tasks posted from other threads, so all protocol
+ * state can be owned by that one thread. Without a socket, frames can be
+ * injected into the ring instead, e.g. by an in-memory network.
+ */
+class ReceivePipeline {
+public:
+    /** data and sender are only valid during the call */
+    typedef std::function<void(std::string_view data, std::string_view sender,
+        const std::chrono::system_clock::time_point &ts)> Handler;
+
+    static const size_t RING_SIZE = 1024;
+    static const size_t MAX_BATCH = 32;
+
+    ReceivePipeline();
+    ~ReceivePipeline();
+    ReceivePipeline(const ReceivePipeline &) = delete;
+    ReceivePipeline &operator=(const ReceivePipeline &) = delete;
+
+    bool start(Handler handler);
+    bool listen(const std::string &ip, uint16_t port);
+    bool inject(const char *data, size_t length, const sockaddr_in &from,
+                const std::chrono::system_clock::time_point &arrival);
+    void stop();
+    bool setThreadPolicy(const ThreadPolicy &receiver, const ThreadPolicy &worker);
+    void post(std::function<void()> task);
+    void execute(std::function<void()> task);
+
+    uint64_t received() const { return receivedFrames.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return droppedFrames.load(std::memory_order_relaxed); }
+    uint64_t batches() const { return receiveCalls.load(std::memory_order_relaxed); }
+
+private:
+    enum State { IDLE, RUNNING, STOPPED };
+
+    int socketFd;
+    std::atomic<int> state;
+    Handler handler;
+    std::unique_ptr<SpscRing<ReceivedFrame, RING_SIZE>> ring;
+    std::thread receiverThread;
+    std::thread workerThread;
+    std::thread::id workerId;
+    std::mutex injectMutex;         // one producer on the ring at a time
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool pending;
+    std::vector<std::function<void()>> tasks;
+
+    std::atomic<uint64_t> receivedFrames;
+    std::atomic<uint64_t> droppedFrames;
+    std::atomic<uint64_t> receiveCalls;
+
+    void receive();
+    void work();
+};
+
+#endif //V2V_PROTOCOL_DEMO_RECEIVEPIPELINE_HPP
@@ -0,0 +1,250 @@
+// Vera requires this "Copyright" notice
+
+#include "Recorder.hpp"
+
+Recorder::Recorder()
+    : active(false), file(nullptr), frontUsed(0), recordedEntries(0), droppedEntries(0)
+{
+}
+
+Recorder::~Recorder()
+{
+    close();
+}
+
+/**
+ * Starts recording, appending to the file if it exists.
+ *
+ * @param path - file to write the recording to
+ * @return false if the file could not be opened
+ */
+bool Recorder::open(const std::string &path)
+{
+    if (active.load()) {return false;}
+    file = std::fopen(path.c_str(), "ab");
+    if (nullptr == file) {return false;}
+
+    front.reset(new char[BUFFER_SIZE]);
+    back.reset(new char[BUFFER_SIZE]);
+    frontUsed = 0;
+    active.store(true);
+    writerThread = std::thread(&Recorder::write, this);
+    return true;
+}
+
+/**
+ * Stops recording. Entries still buffered are written before the file is closed.
+ */
+void Recorder::close()
+{
+    if (not active.exchange(false)) {return;}
+    wakeUp.notify_one();
+    if (writerThread.joinable()) {writerThread.join();}
+    std::fclose(file);
+    file = nullptr;
+}
+
+/**
+ * Records a datagram received on the V2V port.
+ *
+ * @param data - received datagram
+ * @param sender - "ip:port" of the sending car
+ * @param arrival - time the datagram was received
+ */
+void Recorder::frame(std::string_view data, std::string_view sender,
+    const std::chrono::system_clock::time_point &arrival) noexcept
+{
+    if (not recording()) {return;}
+
+    char payload[MAX_RECORD_SIZE];
+    WireWriter writer(payload, sizeof(payload));
+    writer.bytes(1, sender.data(), sender.length());
+    writer.bytes(2, data.data(), data.length());
+    char entry[MAX_RECORD_SIZE];
+    const cluon::data::TimeStamp received = toTimeStamp(arrival);
+    const size_t length = writer.overflow() ? 0 : encodeRecord(RECORDED_FRAME, payload,
+        writer.size(), cluon::data::TimeStamp(), received, received, 0, entry, sizeof(entry));
+    append(entry, length);
+}
+
+/**
+ * Records an envelope received on an OD4 session, as it was received.
+ */
+void Recorder::envelope(const cluon::data::Envelope &envelope) noexcept
+{
+    if (not recording()) {return;}
+
+    const std::string data = envelope.serializedData();
+    char entry[MAX_RECORD_SIZE];
+    const size_t length = encodeRecord(envelope.dataType(), data.data(), data.length(),
+        envelope.sent(), envelope.received(), envelope.sampleTimeStamp(),
+        envelope.senderStamp(), entry, sizeof(entry));
+    append(entry, length);
+}
+
+/**
+ * Copies an encoded entry into the front buffer, an empty entry is one that
+ * did not fit MAX_RECORD_SIZE.
+ */
+void Recorder::append(const char *entry, size_t length) noexcept
+{
+    bool half;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (0 == length || not active.load(std::memory_order_relaxed)
+            || frontUsed + length > BUFFER_SIZE)
+        {
+            droppedEntries.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        std::memcpy(front.get() + frontUsed, entry, length);
+        frontUsed += length;
+        half = frontUsed > BUFFER_SIZE / 2;
+    }
+    recordedEntries.fetch_add(1, std::memory_order_relaxed);
+
+    // Leave the other half for what arrives while the writer catches up
+    if (half) {wakeUp.notify_one();}
+}
+
+/**
+ * Writer thread: every FLUSH_INTERVAL, or as soon as the front buffer is half
+ * full, takes the front buffer and writes it out.
+ */
+void Recorder::write()
+{
+    bool running = true;
+    while (running)
+    {
+        size_t length;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wakeUp.wait_for(lock, std::chrono::milliseconds(FLUSH_INTERVAL), [this]()
+                {
+                    return frontUsed > BUFFER_SIZE / 2 || not active.load();
+                });
+            running = active.load();
+            front.swap(back);
+            length = frontUsed;
+            frontUsed = 0;
+        }
+        if (0 == length) {continue;}
+        std::fwrite(back.get(), 1, length, file);
+        std::fflush(file);
+    }
+}
+
+RecordReader::RecordReader(const std::string &path)
+    : input(path, std::ios::binary)
+{
+}
+
+/**
+ * Reads the next envelope.
+ *
+ * @param envelope - filled with the envelope read
+ * @return false at the end of the recording or at a damaged entry
+ */
+bool RecordReader::next(cluon::data::Envelope &envelope)
+{
+    char header[RECORD_HEADER_SIZE];
+    if (not input.read(header, sizeof(header))) {return false;}
+    if (0x0D != static_cast<uint8_t>(header[0]) || 0xA4 != static_cast<uint8_t>(header[1]))
+    {
+        return false;
+    }
+    const uint8_t *h = reinterpret_cast<const uint8_t *>(header);
+    const size_t length = static_cast<size_t>(h[2] | (h[3] << 8) | (h[4] << 16));
+    entry.resize(length);
+    if (not input.read(&entry[0], static_cast<std::streamsize>(length))) {return false;}
+
+    WireReader reader(entry.data(), entry.length());
+    int32_t dataType = 0;
+    uint32_t senderStamp = 0;
+    reader.visit(1, "", "", dataType);
+    reader.visit(6, "", "", senderStamp);
+    const char *data = nullptr;
+    size_t dataLength = 0;
+    reader.bytes(2, data, dataLength);
+
+    // TimeStamp {int32 seconds = 1; int32 microseconds = 2;}
+    auto timeStamp = [&reader](uint32_t id)
+        {
+            cluon::data::TimeStamp time;
+            const char *nested;
+            size_t nestedLength;
+            if (not reader.bytes(id, nested, nestedLength)) {return time;}
+            WireReader fields(nested, nestedLength);
+            int32_t seconds = 0;
+            int32_t microseconds = 0;
+            fields.visit(1, "", "", seconds);
+            fields.visit(2, "", "", microseconds);
+            return time.seconds(seconds).microseconds(microseconds);
+        };
+
+    envelope.dataType(dataType);
+    envelope.serializedData(std::string(nullptr == data ? "" : data, dataLength));
+    envelope.sent(timeStamp(3));
+    envelope.received(timeStamp(4));
+    envelope.sampleTimeStamp(timeStamp(5));
+    envelope.senderStamp(senderStamp);
+    return true;
+}
+
+/**
+ * Encodes an envelope with its record header, the bytes match
+ * cluon::serializeEnvelope.
+ *
+ * @return length of the entry, 0 if it did not fit
+ */
+size_t encodeRecord(int32_t dataType, const char *data, size_t length,
+    const cluon::data::TimeStamp &sent, const cluon::data::TimeStamp &received,
+    const cluon::data::TimeStamp &sampleTimeStamp, uint32_t senderStamp,
+    char *buffer, size_t size) noexcept
+{
+    if (size < RECORD_HEADER_SIZE) {return 0;}
+    WireWriter writer(buffer + RECORD_HEADER_SIZE, size - RECORD_HEADER_SIZE);
+
+    auto timeStamp = [&writer](uint32_t id, const cluon::data::TimeStamp &time)
+        {
+            char nested[16];
+            WireWriter fields(nested, sizeof(nested));
+            int32_t seconds = time.seconds();
+            int32_t microseconds = time.microseconds();
+            fields.visit(1, "", "", seconds);
+            fields.visit(2, "", "", microseconds);
+            writer.bytes(id, nested, fields.size());
+        };
+
+    writer.visit(1, "", "", dataType);
+    writer.bytes(2, data, length);
+    timeStamp(3, sent);
+    timeStamp(4, received);
+    timeStamp(5, sampleTimeStamp);
+    writer.visit(6, "", "", senderStamp);
+    if (writer.overflow() || writer.size() > 0xFFFFFF) {return 0;}
+
+    buffer[0] = static_cast<char>(0x0D);
+    buffer[1] = static_cast<char>(0xA4);
+    buffer[2] = static_cast<char>(writer.size() & 0xFF);
+    buffer[3] = static_cast<char>((writer.size() >> 8) & 0xFF);
+    buffer[4] = static_cast<char>((writer.size() >> 16) & 0xFF);
+    return RECORD_HEADER_SIZE + writer.size();
+}
+
+cluon::data::TimeStamp toTimeStamp(const std::chrono::system_clock::time_point &time) noexcept
+{
+    using namespace std::chrono;
+    const int64_t us = duration_cast<microseconds>(time.time_since_epoch()).count();
+    cluon::data::TimeStamp timeStamp;
+    timeStamp.seconds(static_cast<int32_t>(us / 1000000));
+    timeStamp.microseconds(static_cast<int32_t>(us % 1000000));
+    return timeStamp;
+}
+
+std::chrono::system_clock::time_point fromTimeStamp(const cluon::data::TimeStamp &time) noexcept
+{
+    using namespace std::chrono;
+    return system_clock::time_point(duration_cast<system_clock::duration>(
+        microseconds(static_cast<int64_t>(time.seconds()) * 1000000 + time.microseconds())));
+}
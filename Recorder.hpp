@@ -0,0 +1,109 @@
+#ifndef V2V_PROTOCOL_DEMO_RECORDER_HPP
+#define V2V_PROTOCOL_DEMO_RECORDER_HPP
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "cluon/Envelope.hpp"
+#include "WireCodec.hpp"
+
+
+/********************************************************/
+/** Recording file format *******************************/
+/********************************************************/
+/*
+ * A recording is a sequence of cluon envelopes as in a cluon .rec file:
+ * 0x0D 0xA4, the envelope length as 3 bytes little-endian, the envelope in
+ * protobuf. OD4 envelopes are written as received. Datagrams of the V2V
+ * port become envelopes of type RECORDED_FRAME (RecordedFrame in
+ * Messages.odvd) with their arrival time as received and sample time stamp.
+ */
+static const int32_t RECORDED_FRAME     = 2209;
+static const size_t  RECORD_HEADER_SIZE = 5;
+static const size_t  MAX_RECORD_SIZE    = 4096;
+
+
+/**
+ * Appends what the service receives to a recording.
+ *
+ * Any thread may record. Entries are encoded on the calling thread and
+ * copied into the front of two buffers under a short lock; a background
+ * thread swaps the buffers and writes the back one to the file. When the
+ * front buffer is full the entry is dropped and counted, so the receive
+ * path never waits for the disk.
+ */
+class Recorder {
+public:
+    static const size_t BUFFER_SIZE = 1 << 20;
+    static const uint32_t FLUSH_INTERVAL = 100;     // milliseconds
+
+    Recorder();
+    ~Recorder();
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+
+    bool open(const std::string &path);
+    void close();
+    bool recording() const noexcept { return active.load(std::memory_order_relaxed); }
+
+    void frame(std::string_view data, std::string_view sender,
+               const std::chrono::system_clock::time_point &arrival) noexcept;
+    void envelope(const cluon::data::Envelope &envelope) noexcept;
+
+    uint64_t recorded() const { return recordedEntries.load(std::memory_order_relaxed); }
+    uint64_t dropped() const { return droppedEntries.load(std::memory_order_relaxed); }
+
+private:
+    std::atomic<bool> active;
+    std::FILE *file;
+    std::thread writerThread;
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    std::unique_ptr<char[]> front;
+    std::unique_ptr<char[]> back;
+    size_t frontUsed;
+
+    std::atomic<uint64_t> recordedEntries;
+    std::atomic<uint64_t> droppedEntries;
+
+    void append(const char *entry, size_t length) noexcept;
+    void write();
+};
+
+
+/**
+ * Reads the envelopes of a recording back, in the order they were written.
+ */
+class RecordReader {
+public:
+    explicit RecordReader(const std::string &path);
+
+    bool good() const { return input.good(); }
+    bool next(cluon::data::Envelope &envelope);
+
+private:
+    std::ifstream input;
+    std::string entry;
+};
+
+
+/********************************************************/
+/** Envelope encoding ***********************************/
+/********************************************************/
+size_t encodeRecord(int32_t dataType, const char *data, size_t length,
+                    const cluon::data::TimeStamp &sent, const cluon::data::TimeStamp &received,
+                    const cluon::data::TimeStamp &sampleTimeStamp, uint32_t senderStamp,
+                    char *buffer, size_t size) noexcept;
+cluon::data::TimeStamp toTimeStamp(const std::chrono::system_clock::time_point &time) noexcept;
+std::chrono::system_clock::time_point fromTimeStamp(const cluon::data::TimeStamp &time) noexcept;
+
+#endif //V2V_PROTOCOL_DEMO_RECORDER_HPP
@@ -0,0 +1,97 @@
+// Vera requires this "Copyright" notice
+
+#include "V2VService.hpp"
+
+#include <iomanip>
+
+/**
+ * Feeds a recording made with --rec through the dispatch of an offline
+ * V2VService: datagrams of the V2V port to receive(), the broadcast channel
+ * to receiveBroadcast() and the internal channel to receiveInternal().
+ * Nothing is sent. Liveness and status timers run on the wall clock.
+ */
+int main(int argc, char **argv)
+{
+    auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
+    if (commandlineArguments.count("rec") == 0)
+    {
+        std::cerr << "Example: " << argv[0]
+        << " --rec=traffic.rec [--realtime] [--diff=1000] [--playout-delay=100]" << std::endl;
+        return -1;
+    }
+    V2VConfig config;
+    if (commandlineArguments.count("diff") != 0)
+    {
+        config.timeDiff = static_cast<uint32_t>(stoi(commandlineArguments["diff"]));
+    }
+    if (commandlineArguments.count("playout-delay") != 0)
+    {
+        config.playoutDelay = static_cast<uint32_t>(stoi(commandlineArguments["playout-delay"]));
+    }
+    const bool realtime = commandlineArguments.count("realtime") != 0;
+    if (commandlineArguments.count("log") == 0)
+    {
+        AsyncLog::instance().level(V2V_LOG_OFF);
+    }
+
+    // Read completely first so the file system is not part of the measurement
+    RecordReader reader(commandlineArguments["rec"]);
+    if (not reader.good())
+    {
+        std::cerr << "Cannot read " << commandlineArguments["rec"] << std::endl;
+        return -1;
+    }
+    std::vector<cluon::data::Envelope> envelopes;
+    cluon::data::Envelope envelope;
+    while (reader.next(envelope)) {envelopes.push_back(envelope);}
+    if (envelopes.empty())
+    {
+        std::cerr << "No envelopes in " << commandlineArguments["rec"] << std::endl;
+        return -1;
+    }
+
+    V2VService service(config);
+    uint64_t frames = 0;
+    uint64_t skipped = 0;
+    std::string data;
+    std::string sender;
+    const auto recordingStart = fromTimeStamp(envelopes.front().received());
+    const auto start = std::chrono::steady_clock::now();
+    for (cluon::data::Envelope &next : envelopes)
+    {
+        const auto arrival = fromTimeStamp(next.received());
+        if (realtime) {std::this_thread::sleep_until(start + (arrival - recordingStart));}
+
+        switch (next.dataType())
+        {
+            case RECORDED_FRAME:
+            {
+                const std::string payload = next.serializedData();
+                WireReader frame(payload.data(), payload.length());
+                frame.visit(1, "", "", sender);
+                frame.visit(2, "", "", data);
+                service.receive(data, sender, arrival);
+                frames++;
+            } break;
+            case ANNOUNCE_PRESENCE: service.receiveBroadcast(std::move(next)); break;
+            case IMU:
+            case PEDAL_POSITION:
+            case GROUND_STEERING:
+            case LEADER_ID: service.receiveInternal(std::move(next)); break;
+            default: skipped++;
+        }
+    }
+    const double seconds = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::cout << std::fixed << std::setprecision(3) << envelopes.size() << " envelopes ("
+              << frames << " V2V frames, " << skipped << " skipped) replayed in " << seconds
+              << " s, recorded over "
+              << std::chrono::duration<double>(fromTimeStamp(envelopes.back().received())
+                 - recordingStart).count() << " s" << std::endl;
+    std::cout << std::setprecision(0) << static_cast<double>(envelopes.size()) / seconds
+              << " envelopes/s, " << std::setprecision(1)
+              << seconds * 1e9 / static_cast<double>(envelopes.size()) << " ns/envelope"
+              << std::endl;
+    return 0;
+}
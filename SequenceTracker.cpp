@@ -0,0 +1,129 @@
+// Vera requires this "Copyright" notice
+
+#include "SequenceTracker.hpp"
+
+SequenceTracker::SequenceTracker()
+{
+    reset();
+}
+
+/**
+ * Forgets the peer's numbering and counters, e.g. when following a new leader.
+ */
+void SequenceTracker::reset()
+{
+    stats = SequenceCounters();
+    started = false;
+    newest = 0;
+    window = 0;
+    span = 0;
+    probation = false;
+    candidate = 0;
+}
+
+/**
+ * Places a received sequence number.
+ *
+ * @param sequence - number the peer sent, 0 if it sent none
+ * @return what the number turned out to be, the message should only be
+ *         acted on if it is NEWEST or, where order does not matter, REORDERED
+ */
+Arrival SequenceTracker::arrived(uint32_t sequence)
+{
+    if (0 == sequence) {return Arrival::UNTRACKED;}
+    if (not started)
+    {
+        restart(sequence);
+        return Arrival::NEWEST;
+    }
+
+    // Wrapping difference, skipping 0 which is never sent
+    int64_t delta = static_cast<int32_t>(sequence - newest);
+    if (delta > 0 && sequence < newest) {delta--;}
+    else if (delta < 0 && sequence > newest) {delta++;}
+
+    if (delta > static_cast<int64_t>(MAX_DROPOUT) || delta < -static_cast<int64_t>(MAX_DROPOUT))
+    {
+        // One wild number is dropped, two in a row mean the peer started over
+        if (probation && sequence == candidate + 1)
+        {
+            restart(sequence);
+            return Arrival::NEWEST;
+        }
+        probation = true;
+        candidate = sequence;
+        stats.stale++;
+        return Arrival::STALE;
+    }
+    probation = false;
+
+    if (delta > 0)
+    {
+        const uint64_t ahead = static_cast<uint64_t>(delta);
+        window = ahead >= WINDOW ? 0 : window << ahead;
+        window |= 1;
+        span = ahead + span >= WINDOW ? WINDOW : static_cast<uint32_t>(span + ahead);
+        newest = sequence;
+        stats.expected += ahead;
+        stats.received++;
+        return Arrival::NEWEST;
+    }
+
+    const uint64_t behind = static_cast<uint64_t>(-delta);
+    if (behind >= span)
+    {
+        stats.stale++;
+        return Arrival::STALE;
+    }
+    const uint64_t bit = static_cast<uint64_t>(1) << behind;
+    if (0 != (window & bit))
+    {
+        stats.duplicates++;
+        return Arrival::DUPLICATE;
+    }
+    window |= bit;
+    stats.received++;
+    stats.reordered++;
+    return Arrival::REORDERED;
+}
+
+/**
+ * @return share of the numbers in the window that never arrived, 0..1
+ */
+double SequenceTracker::windowLoss() const
+{
+    if (0 == span) {return 0.0;}
+    const uint64_t covered = span >= 64 ? ~static_cast<uint64_t>(0)
+        : (static_cast<uint64_t>(1) << span) - 1;
+    const int arrivedInWindow = __builtin_popcountll(window & covered);
+    return static_cast<double>(span - static_cast<uint32_t>(arrivedInWindow)) / span;
+}
+
+/**
+ * @return numbers the window covers, windowLoss() is meaningless while this is small
+ */
+uint32_t SequenceTracker::windowSpan() const
+{
+    return span;
+}
+
+SequenceCounters SequenceTracker::counters(bool reset)
+{
+    const SequenceCounters current = stats;
+    if (reset) {stats = SequenceCounters();}
+    return current;
+}
+
+/**
+ * Takes a number as the first of the peer, nothing before it is expected.
+ */
+void SequenceTracker::restart(uint32_t sequence)
+{
+    started = true;
+    newest = sequence;
+    window = 1;
+    span = 1;
+    probation = false;
+    stats.expected++;
+    stats.received++;
+}
@@ -0,0 +1,73 @@
+#ifndef V2V_PROTOCOL_DEMO_SEQUENCETRACKER_HPP
+#define V2V_PROTOCOL_DEMO_SEQUENCETRACKER_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+
+/**
+ * What a received sequence number turned out to be.
+ */
+enum class Arrival
+{
+    NEWEST,         // ahead of everything seen so far, gaps before it count as lost
+    REORDERED,      // fills a gap within the window, it was counted as lost before
+    DUPLICATE,      // seen already
+    STALE,          // too far behind or ahead to place, or the peer restarted its count
+    UNTRACKED       // 0, the peer does not number its messages
+};
+
+
+/**
+ * Counters since the last reset.
+ */
+struct SequenceCounters
+{
+    uint64_t expected;          // sequence numbers the newest one moved past
+    uint64_t received;          // ... of which arrived, in order or not
+    uint64_t reordered;         // arrived after a newer one
+    uint64_t duplicates;
+    uint64_t stale;
+};
+
+
+/**
+ * Loss, reordering and duplicates of the messages of one peer.
+ *
+ * The peer numbers its messages from 1 upwards, wrapping past 0. The last
+ * WINDOW numbers up to the newest are kept as a bitmap, so every arrival
+ * is placed in O(1): ahead of the newest it shifts the window and the gap
+ * counts as lost, inside the window it fills a gap or is a duplicate.
+ * A jump by more than MAX_DROPOUT either way is taken as a restart of the
+ * peer once the number after it arrives, like the probation of RFC 3550.
+ *
+ * Not thread-safe, the caller serializes access.
+ */
+class SequenceTracker {
+public:
+    static const uint32_t WINDOW = 64;
+    static const uint32_t MAX_DROPOUT = 3000;
+
+    SequenceTracker();
+
+    Arrival arrived(uint32_t sequence);
+    void reset();
+    double windowLoss() const;
+    uint32_t windowSpan() const;
+    SequenceCounters counters(bool reset);
+
+    bool tracking() const { return started; }
+
+private:
+    bool started;
+    uint32_t newest;
+    uint64_t window;            // bit i: newest - i arrived
+    uint32_t span;              // numbers the window covers, up to WINDOW
+    bool probation;
+    uint32_t candidate;         // number a restart would continue after
+    SequenceCounters stats;
+
+    void restart(uint32_t sequence);
+};
+
+#endif //V2V_PROTOCOL_DEMO_SEQUENCETRACKER_HPP
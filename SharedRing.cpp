@@ -0,0 +1,240 @@
+// Vera requires this "Copyright" notice
+
+#include "SharedRing.hpp"
+
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <ctime>
+#include <new>
+
+static const uint32_t SEGMENT_MAGIC = 0x56325652;       // "V2VR"
+static const uint32_t SEGMENT_VERSION = 1;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Atomics in shared memory must be lock-free");
+
+SharedRing::SharedRing()
+    : segment(nullptr), owner(false), running(false), writtenRecords(0), wakeCalls(0)
+{
+}
+
+SharedRing::~SharedRing()
+{
+    close();
+}
+
+/**
+ * Creates the segment, replacing one a previous owner left behind.
+ *
+ * @param name - POSIX shared memory name, e.g. "/v2v-internal-out"
+ * @return false if the segment could not be created or mapped
+ */
+bool SharedRing::create(const std::string &name)
+{
+    if (nullptr != segment) {return false;}
+    ::shm_unlink(name.c_str());
+    const int fd = ::shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0660);
+    if (fd < 0) {return false;}
+    if (::ftruncate(fd, sizeof(Segment)) < 0 || not map(fd))
+    {
+        ::close(fd);
+        ::shm_unlink(name.c_str());
+        return false;
+    }
+    ::close(fd);
+
+    new (segment) Segment();
+    segment->version = SEGMENT_VERSION;
+    segment->heartbeat.store(0, std::memory_order_relaxed);
+    segment->sleeping.store(0, std::memory_order_relaxed);
+    segment->wake.store(0, std::memory_order_relaxed);
+    // Written last, a peer attaching meanwhile finds no magic and gives up
+    segment->magic.store(SEGMENT_MAGIC, std::memory_order_release);
+
+    segmentName = name;
+    owner = true;
+    return true;
+}
+
+/**
+ * Maps a segment another process created.
+ *
+ * @param name - POSIX shared memory name the owner created
+ * @return false if there is no such segment or it is of another version
+ */
+bool SharedRing::attach(const std::string &name)
+{
+    if (nullptr != segment) {return false;}
+    const int fd = ::shm_open(name.c_str(), O_RDWR | O_CLOEXEC, 0);
+    if (fd < 0) {return false;}
+    struct stat status;
+    const bool mapped = 0 == ::fstat(fd, &status)
+        && static_cast<size_t>(status.st_size) == sizeof(Segment) && map(fd);
+    ::close(fd);
+    if (not mapped) {return false;}
+
+    if (SEGMENT_MAGIC != segment->magic.load(std::memory_order_acquire)
+        || SEGMENT_VERSION != segment->version)
+    {
+        ::munmap(segment, sizeof(Segment));
+        segment = nullptr;
+        return false;
+    }
+    segmentName = name;
+    owner = false;
+    return true;
+}
+
+/**
+ * Stops reading and unmaps the segment, the owner also removes it.
+ */
+void SharedRing::close()
+{
+    stop();
+    if (nullptr == segment) {return;}
+    ::munmap(segment, sizeof(Segment));
+    segment = nullptr;
+    if (owner) {::shm_unlink(segmentName.c_str());}
+    owner = false;
+}
+
+/**
+ * Becomes the reader of the ring, only one process may read.
+ *
+ * @param handler - called on the reader thread for every payload
+ * @return false if no segment is mapped or the reader runs already
+ */
+bool SharedRing::start(Handler handler)
+{
+    if (nullptr == segment || running.load()) {return false;}
+    this->handler = std::move(handler);
+    segment->heartbeat.store(monotonicMillis(), std::memory_order_relaxed);
+    running.store(true);
+    readerThread = std::thread(&SharedRing::read, this);
+    return true;
+}
+
+/**
+ * Stops the reader thread, writers fall back once they see the heartbeat gone.
+ */
+void SharedRing::stop()
+{
+    if (not running.exchange(false)) {return;}
+    notify();
+    if (readerThread.joinable()) {readerThread.join();}
+    segment->heartbeat.store(0, std::memory_order_relaxed);
+}
+
+/**
+ * Queues a payload for the reader and wakes it if it sleeps.
+ *
+ * @param id - message ID
+ * @param payload - encoded message
+ * @param length - payload length
+ * @param sampleTime - microseconds since the epoch
+ * @return false if nobody reads, the ring is full or the payload too large:
+ *         it is up to the caller to send it another way
+ */
+bool SharedRing::write(int32_t id, const char *payload, size_t length, int64_t sampleTime)
+{
+    if (length > MAX_FRAME_SIZE || not hasReader()) {return false;}
+
+    std::lock_guard<std::mutex> lock(writeMutex);
+    SpscRing<Record, SLOTS> &ring = segment->ring;
+    if (0 == ring.writable()) {return false;}
+    Record &record = ring.slot(0);
+    record.id = id;
+    record.length = static_cast<uint32_t>(length);
+    record.sampleTime = sampleTime;
+    std::memcpy(record.payload, payload, length);
+    ring.produce(1);
+    writtenRecords.fetch_add(1, std::memory_order_relaxed);
+
+    // Pairs with the fence of the reader: either it sees the record or this sees it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (0 != segment->sleeping.load(std::memory_order_relaxed))
+    {
+        notify();
+        wakeCalls.fetch_add(1, std::memory_order_relaxed);
+    }
+    return true;
+}
+
+/**
+ * @return true if a reader showed signs of life within READER_TIMEOUT
+ */
+bool SharedRing::hasReader() const
+{
+    if (nullptr == segment) {return false;}
+    const uint64_t heartbeat = segment->heartbeat.load(std::memory_order_relaxed);
+    return 0 != heartbeat && monotonicMillis() < heartbeat + READER_TIMEOUT;
+}
+
+/**
+ * Maps the segment behind an open shared memory descriptor.
+ */
+bool SharedRing::map(int fd)
+{
+    void *memory = ::mmap(nullptr, sizeof(Segment), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if (MAP_FAILED == memory) {return false;}
+    segment = static_cast<Segment *>(memory);
+    return true;
+}
+
+/**
+ * Reader thread: hands on everything in the ring, then sleeps until a writer
+ * wakes it or it is time for the next heartbeat.
+ */
+void SharedRing::read()
+{
+    SpscRing<Record, SLOTS> &ring = segment->ring;
+    while (running.load(std::memory_order_acquire))
+    {
+        segment->heartbeat.store(monotonicMillis(), std::memory_order_relaxed);
+        if (ring.readable() > 0)
+        {
+            const Record &record = ring.front();
+            const size_t length = std::min<size_t>(record.length, sizeof(record.payload));
+            handler(record.id, std::string_view(record.payload, length), record.sampleTime);
+            ring.consume();
+            continue;
+        }
+
+        const uint32_t seen = segment->wake.load(std::memory_order_acquire);
+        segment->sleeping.store(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (0 == ring.readable())
+        {
+            // Returns at once if a writer bumped wake since it was read
+            timespec timeout;
+            timeout.tv_sec = 0;
+            timeout.tv_nsec = static_cast<long>(HEARTBEAT) * 1000000L;
+            ::syscall(SYS_futex, &segment->wake, FUTEX_WAIT, seen, &timeout, nullptr, 0);
+        }
+        segment->sleeping.store(0, std::memory_order_relaxed);
+    }
+}
+
+/**
+ * Wakes the reader, whichever process it is in.
+ */
+void SharedRing::notify()
+{
+    segment->wake.fetch_add(1, std::memory_order_release);
+    ::syscall(SYS_futex, &segment->wake, FUTEX_WAKE, 1, nullptr, nullptr, 0);
+}
+
+/**
+ * @return milliseconds of CLOCK_MONOTONIC, which all processes of the host share
+ */
+uint64_t SharedRing::monotonicMillis() noexcept
+{
+    timespec now;
+    ::clock_gettime(CLOCK_MONOTONIC, &now);
+    return static_cast<uint64_t>(now.tv_sec) * 1000 + static_cast<uint64_t>(now.tv_nsec) / 1000000;
+}
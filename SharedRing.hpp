@@ -0,0 +1,91 @@
+#ifndef V2V_PROTOCOL_DEMO_SHAREDRING_HPP
+#define V2V_PROTOCOL_DEMO_SHAREDRING_HPP
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include "SpscRing.hpp"
+#include "WireCodec.hpp"
+
+
+/**
+ * One direction of the internal channel between two processes on the same
+ * host, as a POSIX shared memory segment holding an SpscRing of payloads.
+ *
+ * The owner creates the segment and removes it again, the peer attaches to
+ * it by name. Either side may be the reader: it calls start() and gets every
+ * payload on a thread of its own, which sleeps on a futex in the segment
+ * while the ring is empty. The writer only makes the wake-up call when the
+ * reader said it is going to sleep, so a busy reader costs no system call.
+ *
+ * The reader keeps a heartbeat in the segment. While it is missing, or the
+ * ring is full, write() returns false and the caller sends on the OD4
+ * session instead, so a process nobody attached to works as before.
+ */
+class SharedRing {
+public:
+    /** payload is only valid during the call */
+    typedef std::function<void(int32_t id, std::string_view payload, int64_t sampleTime)> Handler;
+
+    static const size_t SLOTS = 64;
+    static const uint32_t HEARTBEAT = 250;          // milliseconds between signs of life of the reader
+    static const uint32_t READER_TIMEOUT = 1000;    // ... after which writers fall back
+
+    SharedRing();
+    ~SharedRing();
+    SharedRing(const SharedRing &) = delete;
+    SharedRing &operator=(const SharedRing &) = delete;
+
+    bool create(const std::string &name);
+    bool attach(const std::string &name);
+    void close();
+
+    bool start(Handler handler);
+    void stop();
+
+    bool write(int32_t id, const char *payload, size_t length, int64_t sampleTime);
+    bool hasReader() const;
+
+    uint64_t written() const { return writtenRecords.load(std::memory_order_relaxed); }
+    uint64_t wakeups() const { return wakeCalls.load(std::memory_order_relaxed); }
+
+private:
+    struct Record
+    {
+        int32_t id;
+        uint32_t length;
+        int64_t sampleTime;
+        char payload[MAX_FRAME_SIZE];
+    };
+
+    struct Segment
+    {
+        std::atomic<uint32_t> magic;        // set once the owner initialized the rest
+        uint32_t version;
+        std::atomic<uint64_t> heartbeat;    // monotonic milliseconds of the reader, 0 if none
+        std::atomic<uint32_t> sleeping;     // the reader waits on wake
+        std::atomic<uint32_t> wake;         // futex word, bumped to wake the reader
+        SpscRing<Record, SLOTS> ring;
+    };
+
+    Segment *segment;
+    std::string segmentName;
+    bool owner;
+    Handler handler;
+    std::atomic<bool> running;
+    std::thread readerThread;
+    std::mutex writeMutex;                  // several threads of a process may write
+    std::atomic<uint64_t> writtenRecords;
+    std::atomic<uint64_t> wakeCalls;
+
+    bool map(int fd);
+    void read();
+    void notify();
+    static uint64_t monotonicMillis() noexcept;
+};
+
+#endif //V2V_PROTOCOL_DEMO_SHAREDRING_HPP
@@ -0,0 +1,391 @@
+// Vera requires this "Copyright" notice
+
+#include "V2VService.hpp"
+
+#include <time.h>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iomanip>
+#include <random>
+#include <sstream>
+
+/**
+ * One simulated car and what the scenario observed of it.
+ */
+struct Vehicle
+{
+    std::string ip;
+    std::string leaderIp;                   // head of its platoon, empty for heads
+    bool measured;                          // part of the current phase's statistics
+    std::atomic<int64_t> requested;         // ns after the phase start, 0 until it happens
+    std::atomic<int64_t> paired;
+    std::atomic<bool> following;
+    std::atomic<bool> ticking;              // a tick is waiting for the car's worker
+    uint64_t skipped;                       // ticks not posted because the last one still waited
+    std::chrono::steady_clock::time_point nextTick;
+    std::unique_ptr<V2VService> service;
+
+    Vehicle() : measured(false), requested(0), paired(0), following(false), ticking(false),
+        skipped(0) {}
+};
+
+static std::atomic<int64_t> PHASE_START(0);
+
+static int64_t steadyNanos()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static double cpuSeconds()
+{
+    timespec ts;
+    ::clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) / 1e9;
+}
+
+/**
+ * Prints p50, p99 and max of a set of durations.
+ *
+ * @param name - label of the measurement
+ * @param nanos - durations in nanoseconds, sorted here
+ * @param expected - number of cars the measurement should cover
+ */
+static void report(const std::string &name, std::vector<int64_t> &nanos, size_t expected)
+{
+    std::cout << "  " << std::left << std::setw(12) << name << std::right;
+    if (nanos.empty())
+    {
+        std::cout << "none of " << expected << std::endl;
+        return;
+    }
+    std::sort(nanos.begin(), nanos.end());
+    auto ms = [](int64_t ns) { return static_cast<double>(ns) / 1e6; };
+    std::cout << std::fixed << std::setprecision(1)
+              << "p50 " << std::setw(7) << ms(nanos[nanos.size() / 2]) << " ms  "
+              << "p99 " << std::setw(7) << ms(nanos[(nanos.size() * 99) / 100]) << " ms  "
+              << "max " << std::setw(7) << ms(nanos.back()) << " ms  "
+              << nanos.size() << "/" << expected << std::endl;
+}
+
+/**
+ * Prints the traffic of one phase: broadcasts, the copies of them cars got,
+ * and datagrams, per second.
+ *
+ * @param before - load of the network when the phase started
+ * @param after - ... when it ended
+ * @param seconds - length of the phase
+ * @param size - number of cars
+ */
+static void reportLoad(const NetworkLoad &before, const NetworkLoad &after, double seconds,
+    size_t size)
+{
+    if (seconds <= 0.0) {return;}
+    const double broadcasts = static_cast<double>(after.broadcasts - before.broadcasts) / seconds;
+    std::cout << "  " << std::left << std::setw(12) << "channel" << std::right << std::fixed
+              << std::setprecision(1) << broadcasts << " broadcasts/s ("
+              << broadcasts / static_cast<double>(size) << " per car), "
+              << static_cast<double>(after.deliveries - before.deliveries) / seconds
+              << " copies/s, "
+              << static_cast<double>(after.datagrams - before.datagrams) / seconds
+              << " datagrams/s" << std::endl;
+}
+
+/**
+ * Ticks every car at its own phase of the tick period and moves the heads,
+ * from one thread, until the condition holds or the time is up.
+ *
+ * @return false if the time ran out
+ */
+template <class Done>
+static bool drive(std::vector<std::unique_ptr<Vehicle>> &vehicles, float frequency,
+    std::chrono::steady_clock::duration timeout, Done done)
+{
+    const auto period = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(1.0 / frequency));
+    const auto start = std::chrono::steady_clock::now();
+    while (not done())
+    {
+        const auto now = std::chrono::steady_clock::now();
+        if (now - start > timeout) {return false;}
+        const double t = std::chrono::duration<double>(now.time_since_epoch()).count();
+        for (auto &vehicle : vehicles)
+        {
+            if (now < vehicle->nextTick) {continue;}
+            vehicle->nextTick += period;
+            V2VService *service = vehicle->service.get();
+            // Like the time trigger of a car, a tick does not start before the last one ended
+            if (vehicle->ticking.exchange(true))
+            {
+                vehicle->skipped++;
+            }
+            else
+            {
+                Vehicle *ticked = vehicle.get();
+                service->post([service, ticked]()
+                    {
+                        service->tick();
+                        ticked->ticking = false;
+                    });
+            }
+            // The driver is the only writer of every car's vehicle state
+            if (vehicle->leaderIp.empty())
+            {
+                VehicleState state;
+                state.speed = 0.5f + 0.2f * static_cast<float>(std::sin(t));
+                state.steeringAngle = 0.1f * static_cast<float>(std::cos(t));
+                state.distanceTraveled = 0;
+                service->vehicleState(state);
+            }
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return true;
+}
+
+/**
+ * Runs one fleet through the scenario: platoons form from AnnouncePresence,
+ * run for a while, then some followers stop and have to find their head again.
+ *
+ * @param size - number of cars
+ * @param platoon - followers per head
+ * @param loopback - UDP on 127.0.0.0/8 and OD4 instead of the in-memory network
+ * @param base - configuration shared by all cars
+ * @param steady - seconds of steady state to measure CPU over
+ */
+static void simulate(size_t size, size_t platoon, bool loopback, const V2VConfig &base,
+    double steady)
+{
+    MemoryNetwork network;
+    std::vector<std::unique_ptr<Vehicle>> vehicles;
+    std::mt19937 random(static_cast<uint32_t>(size));
+    std::uniform_real_distribution<double> phase(0.0, 1.0 / base.frequency);
+
+    const double constructStart = cpuSeconds();
+    const auto wallStart = std::chrono::steady_clock::now();
+    std::string head;
+    std::string group;
+    for (size_t i = 0; i < size; i++)
+    {
+        std::unique_ptr<Vehicle> vehicle(new Vehicle());
+        const size_t n = i + 1;
+        std::stringstream ip;
+        ip << (loopback ? "127." : "10.") << (n >> 16) << "." << ((n >> 8) & 0xFF) << "." << (n & 0xFF);
+        vehicle->ip = ip.str();
+
+        // Every platoon is a group of its own, followers announce a group nobody follows
+        V2VConfig config = base;
+        config.ip = vehicle->ip;
+        config.maxFollowers = platoon;
+        if (0 == i % (platoon + 1))
+        {
+            head = vehicle->ip;
+            group = "g" + std::to_string(i);
+            config.announceGroup = group;
+            config.followGroup = "-";
+        }
+        else
+        {
+            vehicle->leaderIp = head;
+            vehicle->measured = true;
+            config.announceGroup = "f" + std::to_string(i);
+            config.followGroup = group;
+        }
+        Vehicle *observed = vehicle.get();
+        config.onEvent = [observed](V2VEvent event, std::string_view)
+            {
+                const int64_t at = steadyNanos() - PHASE_START.load(std::memory_order_relaxed);
+                int64_t none = 0;
+                if (V2VEvent::FOLLOW_REQUESTED == event) {observed->requested.compare_exchange_strong(none, at);}
+                if (V2VEvent::FOLLOWING == event) {observed->paired.compare_exchange_strong(none, at);}
+                if (V2VEvent::FOLLOWING == event || V2VEvent::LEADER_LEFT == event)
+                {
+                    observed->following = V2VEvent::FOLLOWING == event;
+                }
+            };
+
+        std::unique_ptr<Transport> transport;
+        if (loopback) {transport.reset(new UdpTransport(BROADCAST_CHANNEL, DEFAULT_PORT, true));}
+        else {transport.reset(new MemoryTransport(network, DEFAULT_PORT));}
+        vehicle->service.reset(new V2VService(config, std::move(transport)));
+        vehicles.push_back(std::move(vehicle));
+    }
+    const size_t followers = size - (size + platoon) / (platoon + 1);
+    std::cout << size << " cars, " << size - followers << " platoons ("
+              << (loopback ? "loopback" : "memory") << "), started in " << std::fixed
+              << std::setprecision(1) << std::chrono::duration<double, std::milli>(
+                 std::chrono::steady_clock::now() - wallStart).count() << " ms, "
+              << (cpuSeconds() - constructStart) * 1e6 / static_cast<double>(size)
+              << " us CPU per car" << std::endl;
+
+    auto pairedCount = [&vehicles]()
+        {
+            size_t count = 0;
+            for (auto &vehicle : vehicles)
+            {
+                count += vehicle->following.load() ? 1 : 0;
+            }
+            return count;
+        };
+    auto collect = [&vehicles](std::vector<int64_t> &requested, std::vector<int64_t> &paired)
+        {
+            for (auto &vehicle : vehicles)
+            {
+                if (not vehicle->measured) {continue;}
+                if (0 != vehicle->requested.load()) {requested.push_back(vehicle->requested.load());}
+                if (0 != vehicle->paired.load()) {paired.push_back(vehicle->paired.load());}
+            }
+        };
+    const auto timeout = std::chrono::milliseconds(5000 + 5 * base.timeDiff);
+    // Only the in-memory network counts what it carries
+    NetworkLoad load = network.load();
+    auto phaseLoad = [&](std::chrono::steady_clock::time_point since)
+        {
+            const NetworkLoad now = network.load();
+            if (not loopback)
+            {
+                reportLoad(load, now, std::chrono::duration<double>(
+                    std::chrono::steady_clock::now() - since).count(), vehicles.size());
+            }
+            load = now;
+        };
+
+    // Join: every follower discovers its head and pairs with it
+    const auto now = std::chrono::steady_clock::now();
+    for (auto &vehicle : vehicles)
+    {
+        vehicle->nextTick = now + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(phase(random)));
+    }
+    PHASE_START = steadyNanos();
+    const auto joinStart = std::chrono::steady_clock::now();
+    drive(vehicles, base.frequency, timeout, [&]() { return pairedCount() == followers; });
+    std::vector<int64_t> discovery;
+    std::vector<int64_t> pairing;
+    collect(discovery, pairing);
+    std::cout << " join" << std::endl;
+    report("discovery", discovery, followers);
+    report("pairing", pairing, followers);
+    phaseLoad(joinStart);
+
+    // Steady: platoons keep each other alive, CPU of the whole process shared by all cars
+    const double cpuBefore = cpuSeconds();
+    const auto steadyStart = std::chrono::steady_clock::now();
+    drive(vehicles, base.frequency, std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+        std::chrono::duration<double>(steady)), []() { return false; });
+    const double wall = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - steadyStart).count();
+    const double cpu = cpuSeconds() - cpuBefore;
+    uint64_t skipped = 0;
+    SendCounters sent = SendCounters();
+    for (auto &vehicle : vehicles)
+    {
+        skipped += vehicle->skipped;
+        const SendCounters counters = vehicle->service->sendCounters();
+        sent.sockets += counters.sockets;
+        sent.calls += counters.calls;
+        sent.datagrams += counters.datagrams;
+    }
+    std::cout << " steady" << std::endl << "  " << std::left << std::setw(12) << "cpu"
+              << std::right << std::setprecision(3) << cpu / wall * 100.0 << " % of a core, "
+              << cpu / wall * 1e6 / static_cast<double>(size) << " us/s per car, "
+              << pairedCount() << "/" << followers << " still paired, " << skipped
+              << " ticks skipped so far" << std::endl;
+    std::cout << "  " << std::left << std::setw(12) << "senders" << std::right
+              << sent.sockets << " sockets, " << std::setprecision(1)
+              << static_cast<double>(sent.calls) / static_cast<double>(size) << " sends and "
+              << static_cast<double>(sent.datagrams) / static_cast<double>(size)
+              << " datagrams per car so far" << std::endl;
+    phaseLoad(steadyStart);
+
+    // Stop: every tenth follower leaves its head and has to find it again
+    size_t stopped = 0;
+    for (size_t i = 0; i < vehicles.size(); i++)
+    {
+        Vehicle &vehicle = *vehicles[i];
+        vehicle.measured = 0 == i % 10 && not vehicle.leaderIp.empty();
+        if (not vehicle.measured) {continue;}
+        vehicle.requested = 0;
+        vehicle.paired = 0;
+        vehicle.following = false;
+        stopped++;
+    }
+    PHASE_START = steadyNanos();
+    const auto stopStart = std::chrono::steady_clock::now();
+    for (auto &stopping : vehicles)
+    {
+        Vehicle &vehicle = *stopping;
+        if (not vehicle.measured) {continue;}
+        V2VService *service = vehicle.service.get();
+        const std::string leader = vehicle.leaderIp;
+        service->post([service, leader]() { service->stopFollow(leader); });
+    }
+    drive(vehicles, base.frequency, timeout, [&]() { return pairedCount() == followers; });
+    std::vector<int64_t> rediscovery;
+    std::vector<int64_t> repairing;
+    collect(rediscovery, repairing);
+    std::cout << " stop " << stopped << std::endl;
+    report("discovery", rediscovery, stopped);
+    report("pairing", repairing, stopped);
+    phaseLoad(stopStart);
+
+    const auto teardownStart = std::chrono::steady_clock::now();
+    vehicles.clear();
+    std::cout << " stopped in " << std::setprecision(1) << std::chrono::duration<double, std::milli>(
+        std::chrono::steady_clock::now() - teardownStart).count() << " ms" << std::endl << std::endl;
+}
+
+/**
+ * Runs fleets of growing size, each car a V2VService of its own, on an
+ * in-memory network or on UDP over loopback, and reports how long platoons
+ * take to form and what a car costs in CPU as the fleet grows.
+ */
+int main(int argc, char **argv)
+{
+    auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
+    V2VConfig base;
+    base.frequency = commandlineArguments.count("freq") != 0 ? stof(commandlineArguments["freq"]) : 5.0f;
+    if (commandlineArguments.count("diff") != 0)
+    {
+        base.timeDiff = static_cast<uint32_t>(stoi(commandlineArguments["diff"]));
+    }
+    base.statsInterval = 0;
+    const size_t platoon = commandlineArguments.count("platoon") != 0
+        ? static_cast<size_t>(stoi(commandlineArguments["platoon"])) : 7;
+    const double steady = commandlineArguments.count("steady") != 0
+        ? stod(commandlineArguments["steady"]) : 3.0;
+    const bool loopback = commandlineArguments.count("transport") != 0
+        && commandlineArguments["transport"] == "loopback";
+    if (base.frequency <= 0 || 0 == platoon)
+    {
+        std::cerr << "Example: " << argv[0]
+        << " [--transport=memory|loopback] [--sizes=50,100,200,400] [--platoon=7]"
+        << " [--announce=trickle|fixed] [--bundle=0]"
+        << " [--freq=5] [--diff=1000] [--steady=3]" << std::endl;
+        return -1;
+    }
+    // "fixed" announces once per tick period like before the announce scheduler, for comparison
+    if (commandlineArguments.count("announce") != 0 && commandlineArguments["announce"] == "fixed")
+    {
+        base.announceMaxInterval = static_cast<uint32_t>(1000.0f / base.frequency);
+        base.announceRedundancy = 0;
+    }
+    if (commandlineArguments.count("bundle") != 0)
+    {
+        base.bundleDeadline = static_cast<uint32_t>(stoi(commandlineArguments["bundle"]));
+    }
+    if (commandlineArguments.count("log") == 0)
+    {
+        AsyncLog::instance().level(V2V_LOG_OFF);
+    }
+
+    std::stringstream sizes(commandlineArguments.count("sizes") != 0
+        ? commandlineArguments["sizes"] : "50,100,200,400");
+    std::string size;
+    while (std::getline(sizes, size, ','))
+    {
+        simulate(static_cast<size_t>(stoi(size)), platoon, loopback, base, steady);
+    }
+    return 0;
+}
@@ -0,0 +1,71 @@
+#ifndef V2V_PROTOCOL_DEMO_SPSCRING_HPP
+#define V2V_PROTOCOL_DEMO_SPSCRING_HPP
+
+#include <atomic>
+#include <cstddef>
+
+
+/**
+ * Bounded single-producer single-consumer ring.
+ *
+ * Elements are written and read in place: the producer fills the slots it
+ * was given and publishes them with produce(), the consumer reads the front
+ * slot and releases it with consume(). Each side only stores its own index,
+ * so one release store per call is all the synchronization there is.
+ *
+ * @tparam T - element type
+ * @tparam N - capacity, a power of two
+ */
+template <class T, size_t N>
+class SpscRing {
+    static_assert(0 == (N & (N - 1)), "Capacity must be a power of two");
+
+public:
+    SpscRing() noexcept : head(0), tail(0) {}
+
+    /** Producer: number of slots that can be filled */
+    size_t writable() const noexcept
+    {
+        return N - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire));
+    }
+
+    /** Producer: the i-th free slot, valid for i < writable() */
+    T &slot(size_t i) noexcept
+    {
+        return elements[(head.load(std::memory_order_relaxed) + i) & (N - 1)];
+    }
+
+    /** Producer: hands the first n filled slots to the consumer */
+    void produce(size_t n) noexcept
+    {
+        head.store(head.load(std::memory_order_relaxed) + n, std::memory_order_release);
+    }
+
+    /** Consumer: number of slots waiting */
+    size_t readable() const noexcept
+    {
+        return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+    }
+
+    /** Consumer: oldest waiting slot, valid if readable() > 0 */
+    T &front() noexcept
+    {
+        return elements[tail.load(std::memory_order_relaxed) & (N - 1)];
+    }
+
+    /** Consumer: gives the front slot back to the producer */
+    void consume() noexcept
+    {
+        tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+    }
+
+private:
+    // Padding instead of alignas, so rings can live on the heap before C++17
+    T elements[N];
+    char headLine[64];
+    std::atomic<size_t> head;
+    char tailLine[64];
+    std::atomic<size_t> tail;
+};
+
+#endif //V2V_PROTOCOL_DEMO_SPSCRING_HPP
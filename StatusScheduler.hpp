@@ -0,0 +1,110 @@
+#ifndef V2V_PROTOCOL_DEMO_STATUSSCHEDULER_HPP
+#define V2V_PROTOCOL_DEMO_STATUSSCHEDULER_HPP
+
+#include <cmath>
+#include <cstdint>
+#include "VehicleState.hpp"
+
+
+/**
+ * Thresholds and intervals of the LeaderStatus send policy, intervals in milliseconds.
+ */
+struct StatusPolicy
+{
+    float speedDelta;           // change of speed that is sent right away
+    float steeringDelta;        // change of steering angle that is sent right away
+    uint32_t minInterval;       // gap enforced between two sends, bursts are coalesced
+    uint32_t keepAlive;         // interval while the state is steady and the link is clean
+    uint32_t deadline;          // time after which followers give the leader up (TIME_DIFF)
+};
+
+
+/**
+ * Decides when a leader sends LeaderStatus.
+ *
+ * A state that differs from the last sent one by more than a threshold is
+ * due at once, or as soon as minInterval has passed since the last send.
+ * Otherwise the state is repeated at the keep-alive interval.
+ *
+ * The keep-alive interval adapts to the loss ratio of the link: it is
+ * chosen so that, with independent losses, the chance that every status
+ * within one deadline gets lost stays below MISS_PROBABILITY. A clean link
+ * uses the configured keep-alive, a lossy one sends more often down to
+ * minInterval.
+ *
+ * Not thread-safe, the caller serializes access.
+ */
+class StatusScheduler {
+public:
+    static constexpr double MISS_PROBABILITY = 1e-3;
+
+    explicit StatusScheduler(const StatusPolicy &policy) noexcept
+        : policy(policy), keepAliveInterval(0), lastSent(0), hasSent(false), loss(0.0)
+    {
+        lossRatio(0.0);
+    }
+
+    /**
+     * @return milliseconds until the state should be sent, 0 if it is due now
+     */
+    uint32_t due(const VehicleState &state, uint64_t nowMicros) const noexcept
+    {
+        if (not hasSent) {return 0;}
+        const uint64_t since = (nowMicros - lastSent) / 1000;
+        const uint32_t wait = changed(state) ? policy.minInterval : keepAliveInterval;
+        return since >= wait ? 0 : static_cast<uint32_t>(wait - since);
+    }
+
+    /**
+     * Records a state that was just sent, it is the reference for change detection.
+     */
+    void sent(const VehicleState &state, uint64_t nowMicros) noexcept
+    {
+        lastState = state;
+        lastSent = nowMicros;
+        hasSent = true;
+    }
+
+    /**
+     * Sets the measured loss ratio (0..1) and recomputes the keep-alive interval.
+     */
+    void lossRatio(double ratio) noexcept
+    {
+        loss = ratio < 0.0 ? 0.0 : (ratio > 0.99 ? 0.99 : ratio);
+
+        // Statuses needed per deadline so that all of them are lost with MISS_PROBABILITY
+        uint32_t perDeadline = 2;
+        if (loss > 0.0)
+        {
+            const double needed = std::ceil(std::log(MISS_PROBABILITY) / std::log(loss));
+            if (needed > perDeadline) {perDeadline = static_cast<uint32_t>(needed);}
+        }
+        uint32_t interval = policy.deadline / perDeadline;
+        if (interval > policy.keepAlive) {interval = policy.keepAlive;}
+        if (interval < policy.minInterval) {interval = policy.minInterval;}
+        keepAliveInterval = interval;
+    }
+
+    /**
+     * @return true if the state moved beyond a threshold since the last send
+     */
+    bool changed(const VehicleState &state) const noexcept
+    {
+        return not hasSent
+            || std::fabs(state.speed - lastState.speed) > policy.speedDelta
+            || std::fabs(state.steeringAngle - lastState.steeringAngle) > policy.steeringDelta;
+    }
+
+    double lossRatio() const noexcept { return loss; }
+    uint32_t keepAlive() const noexcept { return keepAliveInterval; }
+
+private:
+    StatusPolicy policy;
+    uint32_t keepAliveInterval;
+    VehicleState lastState;
+    uint64_t lastSent;
+    bool hasSent;
+    double loss;
+};
+
+#endif //V2V_PROTOCOL_DEMO_STATUSSCHEDULER_HPP
@@ -0,0 +1,245 @@
+// Vera requires this "Copyright" notice
+
+#include "TimingWheel.hpp"
+
+#include <limits>
+
+TimingWheel::TimingWheel()
+    : running(true), start(std::chrono::steady_clock::now()), now(0), armed(0),
+      sleepingUntil(0)
+{
+    for (auto &slot : slots) {slot = NONE;}
+    driver = std::thread(&TimingWheel::run, this);
+}
+
+TimingWheel::~TimingWheel()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        running = false;
+    }
+    wakeUp.notify_one();
+    driver.join();
+}
+
+/**
+ * Creates a disarmed timer.
+ *
+ * @param onExpire - called on the wheel's thread each time the timer expires
+ * @return id used to arm, cancel and destroy the timer
+ */
+TimingWheel::TimerId TimingWheel::create(std::function<void()> onExpire)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    uint32_t id;
+    if (freeNodes.empty())
+    {
+        id = static_cast<uint32_t>(nodes.size());
+        nodes.emplace_back();
+    }
+    else
+    {
+        id = freeNodes.back();
+        freeNodes.pop_back();
+    }
+    Node &node = nodes[id];
+    node.slot = NONE;
+    node.used = true;
+    node.onExpire = std::move(onExpire);
+    return id;
+}
+
+/**
+ * Arms a timer, or moves its deadline if it is already armed.
+ *
+ * @param id - timer to arm
+ * @param timeoutMs - milliseconds from now until the timer expires
+ */
+void TimingWheel::schedule(TimerId id, uint32_t timeoutMs)
+{
+    bool earlier;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (id >= nodes.size() || not nodes[id].used) {return;}
+        if (NONE != nodes[id].slot) {unlink(id);}
+        else {armed++;}
+
+        // Deadlines are relative to the current time, not to the last processed tick
+        const uint64_t deadline = elapsed() + timeoutMs;
+        nodes[id].expires = deadline;
+        link(id);
+        earlier = deadline < sleepingUntil;
+    }
+    if (earlier) {wakeUp.notify_one();}
+}
+
+/**
+ * Disarms a timer without destroying it.
+ */
+void TimingWheel::cancel(TimerId id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id >= nodes.size() || NONE == nodes[id].slot) {return;}
+    unlink(id);
+    armed--;
+}
+
+/**
+ * Disarms a timer and releases its id for reuse.
+ */
+void TimingWheel::destroy(TimerId id)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    if (id >= nodes.size() || not nodes[id].used) {return;}
+    if (NONE != nodes[id].slot)
+    {
+        unlink(id);
+        armed--;
+    }
+    nodes[id].used = false;
+    nodes[id].onExpire = nullptr;
+    freeNodes.push_back(id);
+}
+
+/**
+ * Pins and prioritizes the driver thread, see applyThreadPolicy().
+ *
+ * @return false if the driver could not be changed
+ */
+bool TimingWheel::setThreadPolicy(const ThreadPolicy &policy)
+{
+    return policy.isDefault() || applyThreadPolicy(driver.native_handle(), policy);
+}
+
+uint64_t TimingWheel::elapsed() const
+{
+    using namespace std::chrono;
+    return static_cast<uint64_t>(
+        duration_cast<milliseconds>(steady_clock::now() - start).count());
+}
+
+/**
+ * Puts an armed node into the slot matching its deadline: the finest level
+ * whose parent block it shares with the current tick.
+ */
+void TimingWheel::link(uint32_t id)
+{
+    Node &node = nodes[id];
+    if (node.expires <= now) {node.expires = now + 1;}
+
+    unsigned level = 0;
+    while (level < LEVELS - 1
+        && (node.expires >> (SLOT_BITS * (level + 1))) != (now >> (SLOT_BITS * (level + 1))))
+    {
+        level++;
+    }
+    const uint32_t slot = level * SLOTS
+        + static_cast<uint32_t>((node.expires >> (SLOT_BITS * level)) & (SLOTS - 1));
+
+    node.slot = slot;
+    node.prev = NONE;
+    node.next = slots[slot];
+    if (NONE != node.next) {nodes[node.next].prev = id;}
+    slots[slot] = id;
+}
+
+void TimingWheel::unlink(uint32_t id)
+{
+    Node &node = nodes[id];
+    if (NONE != node.prev) {nodes[node.prev].next = node.next;}
+    else {slots[node.slot] = node.next;}
+    if (NONE != node.next) {nodes[node.next].prev = node.prev;}
+    node.slot = NONE;
+}
+
+/**
+ * Turns the wheel up to the target tick, cascading coarse slots down and
+ * collecting the callbacks of every timer that expired on the way.
+ */
+void TimingWheel::advance(uint64_t target, std::vector<std::function<void()>> &expired)
+{
+    while (now < target)
+    {
+        if (0 == armed)
+        {
+            now = target;
+            return;
+        }
+        now++;
+
+        for (unsigned level = LEVELS - 1; level >= 1; level--)
+        {
+            if (0 != (now & ((static_cast<uint64_t>(1) << (SLOT_BITS * level)) - 1))) {continue;}
+            const uint32_t slot = level * SLOTS
+                + static_cast<uint32_t>((now >> (SLOT_BITS * level)) & (SLOTS - 1));
+            uint32_t id = slots[slot];
+            slots[slot] = NONE;
+            while (NONE != id)
+            {
+                const uint32_t next = nodes[id].next;
+                link(id);
+                id = next;
+            }
+        }
+
+        const uint32_t slot = static_cast<uint32_t>(now & (SLOTS - 1));
+        uint32_t id = slots[slot];
+        slots[slot] = NONE;
+        while (NONE != id)
+        {
+            Node &node = nodes[id];
+            const uint32_t next = node.next;
+            node.slot = NONE;
+            armed--;
+            expired.push_back(node.onExpire);
+            id = next;
+        }
+    }
+}
+
+/**
+ * @return the first tick with an occupied level 0 slot or a cascade to do
+ */
+uint64_t TimingWheel::nextWakeUp() const
+{
+    if (0 == armed) {return std::numeric_limits<uint64_t>::max();}
+    for (uint64_t tick = now + 1; ; tick++)
+    {
+        if (NONE != slots[tick & (SLOTS - 1)] || 0 == (tick & (SLOTS - 1))) {return tick;}
+    }
+}
+
+void TimingWheel::run()
+{
+    // Sized up front, so timers expiring together do not allocate once running
+    std::vector<std::function<void()>> expired;
+    expired.reserve(SLOTS);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (running)
+    {
+        advance(elapsed(), expired);
+        if (not expired.empty())
+        {
+            // Callbacks may use the wheel themselves
+            lock.unlock();
+            for (auto &onExpire : expired)
+            {
+                if (onExpire) {onExpire();}
+            }
+            expired.clear();
+            lock.lock();
+            continue;
+        }
+
+        sleepingUntil = nextWakeUp();
+        if (std::numeric_limits<uint64_t>::max() == sleepingUntil)
+        {
+            wakeUp.wait(lock);
+        }
+        else
+        {
+            wakeUp.wait_until(lock, start + std::chrono::milliseconds(sleepingUntil));
+        }
+        sleepingUntil = 0;
+    }
+}
@@ -0,0 +1,78 @@
+#ifndef V2V_PROTOCOL_DEMO_TIMINGWHEEL_HPP
+#define V2V_PROTOCOL_DEMO_TIMINGWHEEL_HPP
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "RealTime.hpp"
+
+
+/**
+ * Hierarchical timing wheel (Varghese & Lauck) on the monotonic clock.
+ *
+ * Timers are created once per peer and re-armed on every status message.
+ * Arming, re-arming and cancelling unlink and link a node in a slot list, so
+ * they are O(1) no matter how many timers exist. A driver thread sleeps until
+ * the next occupied slot and runs the callbacks of expired timers as soon as
+ * their deadline passes.
+ *
+ * Level 0 has one slot per millisecond for the next 64 ms, every further
+ * level covers 64 times the range of the previous one. Timers further out are
+ * cascaded down to finer levels as the wheel turns.
+ */
+class TimingWheel {
+public:
+    typedef uint32_t TimerId;
+
+    TimingWheel();
+    ~TimingWheel();
+    TimingWheel(const TimingWheel &) = delete;
+    TimingWheel &operator=(const TimingWheel &) = delete;
+
+    TimerId create(std::function<void()> onExpire);
+    void schedule(TimerId id, uint32_t timeoutMs);
+    void cancel(TimerId id);
+    void destroy(TimerId id);
+    bool setThreadPolicy(const ThreadPolicy &policy);
+
+private:
+    static const unsigned SLOT_BITS = 6;
+    static const uint32_t SLOTS = 1u << SLOT_BITS;
+    static const unsigned LEVELS = 4;
+    static const uint32_t NONE = 0xFFFFFFFF;
+
+    struct Node
+    {
+        uint64_t expires;
+        uint32_t prev;
+        uint32_t next;
+        uint32_t slot;          // index into slots, NONE while not armed
+        bool used;
+        std::function<void()> onExpire;
+    };
+
+    std::mutex mutex;
+    std::condition_variable wakeUp;
+    bool running;
+    std::chrono::steady_clock::time_point start;
+    uint64_t now;               // ticks (milliseconds since start) processed so far
+    uint32_t armed;
+    uint64_t sleepingUntil;     // tick the driver waits for, 0 while it is awake
+    std::vector<Node> nodes;
+    std::vector<uint32_t> freeNodes;
+    uint32_t slots[LEVELS * SLOTS];
+    std::thread driver;
+
+    uint64_t elapsed() const;
+    void link(uint32_t id);
+    void unlink(uint32_t id);
+    void advance(uint64_t target, std::vector<std::function<void()>> &expired);
+    uint64_t nextWakeUp() const;
+    void run();
+};
+
+#endif //V2V_PROTOCOL_DEMO_TIMINGWHEEL_HPP
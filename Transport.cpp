@@ -0,0 +1,203 @@
+// Vera requires this "Copyright" notice
+
+#include "Transport.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+UdpTransport::UdpTransport(int broadcastChannel, uint16_t port, bool bindToIp)
+    : broadcastChannel(broadcastChannel), port(port), bindToIp(bindToIp)
+{
+}
+
+UdpTransport::~UdpTransport()
+{
+    close();
+}
+
+bool UdpTransport::open(const std::string &ip, ReceivePipeline &pipeline,
+    BroadcastHandler onBroadcast)
+{
+    if (not pipeline.listen(bindToIp ? ip : "0.0.0.0", port)) {return false;}
+    if (bindToIp && not sender.bind(ip)) {return false;}
+    session = std::make_shared<cluon::OD4Session>(broadcastChannel,
+        [onBroadcast](cluon::data::Envelope &&envelope) noexcept
+        {
+            onBroadcast(std::move(envelope));
+        });
+    return true;
+}
+
+void UdpTransport::close()
+{
+    session.reset();
+}
+
+void UdpTransport::broadcast(cluon::data::Envelope &&envelope)
+{
+    if (session) {session->send(std::move(envelope));}
+}
+
+size_t UdpTransport::send(const BatchTarget *targets, size_t count, const char *payload,
+    size_t length)
+{
+    return sender.send(targets, count, payload, length);
+}
+
+SendCounters UdpTransport::counters() const
+{
+    return sender.counters();
+}
+
+/**
+ * Makes a car reachable.
+ *
+ * @param address - IP of the car, the port is ignored
+ * @param pipeline - started receive pipeline datagrams for the car go into
+ * @param onBroadcast - called with the broadcasts of all other cars
+ * @return false if another car has the same IP
+ */
+bool MemoryNetwork::attach(const sockaddr_in &address, ReceivePipeline *pipeline,
+    Transport::BroadcastHandler onBroadcast)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    const in_addr_t ip = address.sin_addr.s_addr;
+    if (nullptr != find(ip)) {return false;}
+    auto at = std::lower_bound(stations.begin(), stations.end(), ip,
+        [](const Station &station, in_addr_t key) { return station.ip < key; });
+    stations.insert(at, Station{ip, pipeline, std::move(onBroadcast)});
+    return true;
+}
+
+/**
+ * Makes a car unreachable. No datagram or broadcast reaches it once this returns.
+ */
+void MemoryNetwork::detach(const sockaddr_in &address)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    Station *station = find(address.sin_addr.s_addr);
+    if (nullptr != station) {stations.erase(stations.begin() + (station - stations.data()));}
+}
+
+/**
+ * Hands an envelope to every car but the sender, like a multicast group
+ * without loopback.
+ */
+void MemoryNetwork::broadcast(const sockaddr_in &from, const cluon::data::Envelope &envelope)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    traffic.broadcasts++;
+    for (Station &station : stations)
+    {
+        if (station.ip == from.sin_addr.s_addr) {continue;}
+        cluon::data::Envelope copy = envelope;
+        station.onBroadcast(std::move(copy));
+        traffic.deliveries++;
+    }
+}
+
+/**
+ * Delivers one datagram per target into the pipeline of the car at its
+ * address. Targets nobody is attached at are lost, as on a real network.
+ *
+ * @return number of datagrams delivered
+ */
+size_t MemoryNetwork::send(const sockaddr_in &from, const BatchTarget *targets, size_t count,
+    const char *payload, size_t length)
+{
+    char frame[MAX_FRAME_SIZE];
+    const auto arrival = std::chrono::system_clock::now();
+    size_t delivered = 0;
+    std::lock_guard<std::mutex> lock(mutex);
+    for (size_t i = 0; i < count; i++)
+    {
+        const BatchTarget &target = targets[i];
+        if (target.headerLength + length > sizeof(frame)) {continue;}
+        Station *station = find(target.address.sin_addr.s_addr);
+        if (nullptr == station) {continue;}
+
+        std::memcpy(frame, target.header, target.headerLength);
+        std::memcpy(frame + target.headerLength, payload, length);
+        if (station->pipeline->inject(frame, target.headerLength + length, from, arrival))
+        {
+            delivered++;
+        }
+    }
+    traffic.datagrams += delivered;
+    return delivered;
+}
+
+/**
+ * @return traffic carried since the network was created
+ */
+NetworkLoad MemoryNetwork::load()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return traffic;
+}
+
+/**
+ * @return the car attached at ip, nullptr if there is none
+ */
+MemoryNetwork::Station *MemoryNetwork::find(in_addr_t ip)
+{
+    auto at = std::lower_bound(stations.begin(), stations.end(), ip,
+        [](const Station &station, in_addr_t key) { return station.ip < key; });
+    return at != stations.end() && at->ip == ip ? &*at : nullptr;
+}
+
+MemoryTransport::MemoryTransport(MemoryNetwork &network, uint16_t port)
+    : network(network), port(port), attached(false), calls(0), datagrams(0), failed(0)
+{
+    std::memset(&address, 0, sizeof(address));
+}
+
+MemoryTransport::~MemoryTransport()
+{
+    close();
+}
+
+bool MemoryTransport::open(const std::string &ip, ReceivePipeline &pipeline,
+    BroadcastHandler onBroadcast)
+{
+    if (attached || not BatchSender::resolve(ip, port, address)) {return false;}
+    attached = network.attach(address, &pipeline, std::move(onBroadcast));
+    return attached;
+}
+
+void MemoryTransport::close()
+{
+    if (not attached) {return;}
+    network.detach(address);
+    attached = false;
+}
+
+void MemoryTransport::broadcast(cluon::data::Envelope &&envelope)
+{
+    if (attached) {network.broadcast(address, envelope);}
+}
+
+size_t MemoryTransport::send(const BatchTarget *targets, size_t count, const char *payload,
+    size_t length)
+{
+    if (not attached || 0 == count) {return 0;}
+    const size_t delivered = network.send(address, targets, count, payload, length);
+    calls.fetch_add(1, std::memory_order_relaxed);
+    datagrams.fetch_add(delivered, std::memory_order_relaxed);
+    failed.fetch_add(count - delivered, std::memory_order_relaxed);
+    return delivered;
+}
+
+/**
+ * @return what the car sent, it has no socket of its own
+ */
+SendCounters MemoryTransport::counters() const
+{
+    SendCounters current;
+    current.sockets = 0;
+    current.calls = calls.load(std::memory_order_relaxed);
+    current.datagrams = datagrams.load(std::memory_order_relaxed);
+    current.failed = failed.load(std::memory_order_relaxed);
+    return current;
+}
@@ -0,0 +1,158 @@
+#ifndef V2V_PROTOCOL_DEMO_TRANSPORT_HPP
+#define V2V_PROTOCOL_DEMO_TRANSPORT_HPP
+
+#include <netinet/in.h>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "cluon/OD4Session.hpp"
+#include "cluon/Envelope.hpp"
+#include "BatchSender.hpp"
+#include "ReceivePipeline.hpp"
+
+
+/**
+ * Carries the V2V traffic of one car: the broadcast channel and the
+ * datagrams on its V2V port.
+ */
+class Transport {
+public:
+    typedef std::function<void(cluon::data::Envelope &&envelope)> BroadcastHandler;
+
+    virtual ~Transport() {}
+
+    /**
+     * Starts receiving. Datagrams for the car go into the pipeline, envelopes
+     * of the broadcast channel to the handler, on any thread.
+     *
+     * @param ip - IP of the car
+     * @param pipeline - started receive pipeline of the car
+     * @param onBroadcast - called for every envelope on the broadcast channel
+     * @return false if the car cannot be reached
+     */
+    virtual bool open(const std::string &ip, ReceivePipeline &pipeline,
+                      BroadcastHandler onBroadcast) = 0;
+
+    /** Stops receiving, the handler is not called any more once this returns */
+    virtual void close() = 0;
+
+    /** Sends an envelope on the broadcast channel */
+    virtual void broadcast(cluon::data::Envelope &&envelope) = 0;
+
+    /**
+     * Sends one payload to several cars, each datagram with the header of its target.
+     *
+     * @return number of datagrams sent
+     */
+    virtual size_t send(const BatchTarget *targets, size_t count, const char *payload,
+                        size_t length) = 0;
+
+    /** @return what was sent so far */
+    virtual SendCounters counters() const = 0;
+};
+
+
+/**
+ * The car's network: broadcast channel as OD4 session, V2V port over UDP.
+ */
+class UdpTransport : public Transport {
+public:
+    explicit UdpTransport(int broadcastChannel, uint16_t port, bool bindToIp = false);
+    ~UdpTransport();
+
+    bool open(const std::string &ip, ReceivePipeline &pipeline,
+              BroadcastHandler onBroadcast) override;
+    void close() override;
+    void broadcast(cluon::data::Envelope &&envelope) override;
+    size_t send(const BatchTarget *targets, size_t count, const char *payload,
+                size_t length) override;
+    SendCounters counters() const override;
+
+private:
+    const int broadcastChannel;
+    const uint16_t port;
+    const bool bindToIp;            // listen on the car's IP only, so cars can share a host
+    std::shared_ptr<cluon::OD4Session> session;
+    BatchSender sender;
+};
+
+
+/**
+ * Traffic a MemoryNetwork carried so far.
+ */
+struct NetworkLoad
+{
+    uint64_t broadcasts;        // envelopes sent on the broadcast channel
+    uint64_t deliveries;        // ... times the cars that got a copy
+    uint64_t datagrams;         // datagrams delivered to a V2V port
+};
+
+
+/**
+ * Broadcast channel and V2V ports of many cars in one process. Datagrams
+ * are copied straight into the receive pipeline of the target, broadcasts
+ * are handed to every other car on the sending thread. Nothing is lost
+ * unless a receive ring is full.
+ */
+class MemoryNetwork {
+public:
+    MemoryNetwork() : traffic() {}
+    MemoryNetwork(const MemoryNetwork &) = delete;
+    MemoryNetwork &operator=(const MemoryNetwork &) = delete;
+
+    bool attach(const sockaddr_in &address, ReceivePipeline *pipeline,
+                Transport::BroadcastHandler onBroadcast);
+    void detach(const sockaddr_in &address);
+    void broadcast(const sockaddr_in &from, const cluon::data::Envelope &envelope);
+    size_t send(const sockaddr_in &from, const BatchTarget *targets, size_t count,
+                const char *payload, size_t length);
+    NetworkLoad load();
+
+private:
+    struct Station
+    {
+        in_addr_t ip;
+        ReceivePipeline *pipeline;
+        Transport::BroadcastHandler onBroadcast;
+    };
+
+    // Held while delivering, so a detached car gets nothing once detach() returns
+    std::mutex mutex;
+    std::vector<Station> stations;      // sorted by ip
+    NetworkLoad traffic;
+
+    Station *find(in_addr_t ip);
+};
+
+
+/**
+ * One car on a MemoryNetwork.
+ */
+class MemoryTransport : public Transport {
+public:
+    MemoryTransport(MemoryNetwork &network, uint16_t port);
+    ~MemoryTransport();
+
+    bool open(const std::string &ip, ReceivePipeline &pipeline,
+              BroadcastHandler onBroadcast) override;
+    void close() override;
+    void broadcast(cluon::data::Envelope &&envelope) override;
+    size_t send(const BatchTarget *targets, size_t count, const char *payload,
+                size_t length) override;
+    SendCounters counters() const override;
+
+private:
+    MemoryNetwork &network;
+    const uint16_t port;
+    sockaddr_in address;
+    bool attached;
+    std::atomic<uint64_t> calls;
+    std::atomic<uint64_t> datagrams;
+    std::atomic<uint64_t> failed;
+};
+
+#endif //V2V_PROTOCOL_DEMO_TRANSPORT_HPP
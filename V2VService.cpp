@@ -2,258 +2,625 @@
 
 #include "V2VService.hpp"
 
-int main(int argc, char **argv)
-{
-    std::shared_ptr<V2VService> v2vService = std::make_shared<V2VService>();
-
-    // Getting command line arguments
-    auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
-
-    // In case no IP, time diffrence or frequency is provided do nothing
-    if (commandlineArguments.count("ip") == 0 || commandlineArguments.count("diff") == 0
-      || commandlineArguments.count("freq") == 0)
-    {
-        std::cerr <<
-        "You must specify your car's IP and the desired time to wait between status request"
-        << std::endl;
-        std::cerr << "Example: " << argv[0]
-        << " --ip=192.168.8.1 --diff=2000 --freq=5" << std::endl;;
-        return -1;
-    }
-    else
-    {
-      // Parse arguments
-      DASH_IP = commandlineArguments["ip"];
-      TIME_DIFF = stoi(commandlineArguments["diff"]);
-      FREQ = stof(commandlineArguments["freq"]);
-      // Default leader group number
-      GROUP_ID = "7";
-      // Internal communication OD4 session
-      internal =
-      std::make_shared<cluon::OD4Session>(INTERNAL_CHANNEL,
-        [&v2vService](cluon::data::Envelope &&envelope) noexcept
+/**
+ * @return the number after the last one taken from counter, skipping 0 which means unnumbered
+ */
+static uint32_t nextSequence(std::atomic<uint32_t> &counter)
+{
+    uint32_t current = counter.load(std::memory_order_relaxed);
+    uint32_t next;
+    do
+    {
+        next = UINT32_MAX == current ? 1 : current + 1;
+    } while (not counter.compare_exchange_weak(current, next, std::memory_order_relaxed));
+    return next;
+}
+
+/**
+ * @return a counter narrowed to the uint32 fields of the statistics messages, saturating
+ */
+static uint32_t clamp(uint64_t value)
+{
+    return static_cast<uint32_t>(value > UINT32_MAX ? UINT32_MAX : value);
+}
+
+/**
+ * Implementation of the V2VService class as declared in V2VService.hpp
+ */
+V2VService::V2VService(const V2VConfig &config, std::unique_ptr<Transport> transport)
+    : config(config), leaderGroup(config.followGroup),
+      lastTick(0), lastLeaderTransit(0), hasLeaderTransit(false), lastStatsPublish(0),
+      statusScheduler(StatusPolicy{config.statusSpeedDelta, config.statusSteeringDelta,
+        MIN_STATUS_INTERVAL, config.statusKeepAlive, config.timeDiff}),
+      lastLossEstimate(monotonicMicros()),
+      statusResolution(StatusResolution{getTime(), config.speedResolution,
+        config.steeringResolution}),
+      leaderStatusFormat(StatusFormat::FULL), leaderResolution(StatusResolution{0, 0.0f, 0.0f}),
+      statusSequence(0), followerSequence(0),
+      playoutBuffer(config.playoutDelay, MAX_EXTRAPOLATION), playing(false),
+      peers(DEFAULT_PORT, MAX_PRESENT_CARS),
+      leaderFormat(config.wireFormat), hasLeaderAddress(false), leaderBundles(false),
+      bundler(config.bundleDeadline, [this](const sockaddr_in &to, const char *frame, size_t length)
         {
-          switch (envelope.dataType())
+            BatchTarget target;
+            target.address = to;
+            target.header = frame;
+            target.headerLength = 0;
+            if (this->transport) {this->transport->send(&target, 1, frame, length);}
+        }),
+      presence(MAX_PRESENT_CARS, static_cast<uint64_t>(config.presenceTtl) * 1000),
+      announceScheduler(AnnouncePolicy{config.frequency > 0.0f
+          ? static_cast<uint32_t>(1000.0f / config.frequency) : 200,
+        config.announceMaxInterval, config.announceRedundancy},
+        static_cast<uint32_t>(std::hash<std::string>()(config.ip) ^ monotonicMicros())),
+      transport(std::move(transport))
+{
+    // Losing a peer changes who is followed, which is up to the protocol worker
+    leaderTimer = liveness.create([this]() { pipeline.post([this]() { leaderLost(); }); });
+    statusTimer = liveness.create([this]() { leaderStatus(); });
+    playoutTimer = liveness.create([this]() { playout(); });
+    announceTimer = liveness.create([this]() { pipeline.post([this]() { announce(); }); });
+    bundleTimer = liveness.create([this]() { flushBundles(); });
+
+    dispatcher.on<FollowRequest>(&V2VService::followRequestReceived);
+    dispatcher.on<FollowResponse>(&V2VService::followResponseReceived);
+    dispatcher.on<StopFollow>(&V2VService::stopFollowReceived);
+    dispatcher.on<FollowerStatus>(&V2VService::followerStatusReceived);
+    dispatcher.on<LeaderStatus>(&V2VService::leaderStatusReceived);
+    dispatcher.on<CompactLeaderStatus>(&V2VService::compactLeaderStatusReceived);
+
+    mirrorStage.rate(config.mirrorRate);
+    for (const auto &rate : config.mirrorRates) {mirrorStage.rate(rate.first, rate.second);}
+
+    if (not this->transport) {return;}
+
+    /*
+     * Each car receives the messages directed at it specifically on DEFAULT_PORT.
+     * This is where messages such as FollowRequest, FollowResponse, StopFollow, etc. are received,
+     * all of them handled on the protocol worker of the receive pipeline.
+     */
+    pipeline.start([this](std::string_view data, std::string_view sender,
+        const std::chrono::system_clock::time_point &ts)
+      {
+          receive(data, sender, ts);
+      });
+
+    /*
+     * The broadcast channel is where AnnouncePresence messages will be received.
+     */
+    if (not this->transport->open(config.ip, pipeline,
+          [this](cluon::data::Envelope &&envelope)
           {
-            case IMU:
+              receiveBroadcast(std::move(envelope));
+          }))
+    {
+        LOG_ERROR("[UDP] could not listen on {}:{}", config.ip, DEFAULT_PORT);
+    }
+    if (not pipeline.setThreadPolicy(config.receiveThreads, config.timerThreads)
+      || not liveness.setThreadPolicy(config.timerThreads))
+    {
+        LOG_WARN("Could not set CPU or priority of the timer and receive threads");
+    }
+
+    // The first AnnouncePresence goes out within the first interval
+    uint32_t wait;
+    {
+        std::lock_guard<std::mutex> lock(announceMutex);
+        const uint64_t now = monotonicMicros();
+        announceScheduler.start(now);
+        wait = announceScheduler.wait(now);
+    }
+    liveness.schedule(announceTimer, wait);
+}
+
+V2VService::~V2VService()
+{
+    // Nothing may reach the protocol state while the members go away
+    if (transport) {transport->close();}
+    pipeline.stop();
+    mirrorStage.stop();
+}
+
+/**
+ * Runs a task on the protocol worker, the only thread that changes leaderIp
+ * and the follower table. Offline instances run it right away.
+ */
+void V2VService::post(std::function<void()> task)
+{
+    pipeline.post(std::move(task));
+}
+
+/**
+ * Like post(), but waits until the task has run.
+ */
+void V2VService::execute(std::function<void()> task)
+{
+    pipeline.execute(std::move(task));
+}
+
+/**
+ * Starts sending copies of protocol messages, e.g. to the internal channel.
+ * LinkQuality, PlayoutStats and MirrorStats are only published to a sink.
+ * The protocol threads run already, they pick the sink up atomically; it
+ * can be set once and is never replaced.
+ *
+ * @param sink - receives the payloads, on the thread of the mirror stage
+ *               and, for setpoints and statistics, on the protocol threads
+ * @return false if a sink was set before
+ */
+bool V2VService::publishTo(MirrorStage::Sink sink)
+{
+    std::shared_ptr<const MirrorStage::Sink> none;
+    if (not std::atomic_compare_exchange_strong(&mirrorSink, &none,
+        std::make_shared<const MirrorStage::Sink>(sink))) {return false;}
+    mirrorStage.start(std::move(sink));
+    return true;
+}
+
+/**
+ * Starts appending everything the car receives to a cluon .rec file.
+ *
+ * @param path - file to record to
+ * @return false if the file could not be opened
+ */
+bool V2VService::record(const std::string &path)
+{
+    return recorder.open(path);
+}
+
+/**
+ * Runs the periodic work of the protocol, config.frequency times a second
+ * on the protocol worker: following, FollowerStatus and statistics.
+ * Lost peers are detected by the liveness timers, LeaderStatus follows
+ * vehicle state changes and its own keep-alive, and AnnouncePresence has
+ * a timer of its own.
+ */
+void V2VService::tick()
+{
+    // How far the tick strayed from its period, and how long it ran
+    const uint64_t started = monotonicMicros();
+    if (lastTick > 0 && config.frequency > 0.0f)
+    {
+        const int64_t period = static_cast<int64_t>(started - lastTick);
+        const int64_t error = period - static_cast<int64_t>(1000000.0f / config.frequency);
+        tickPeriodError.record(static_cast<uint64_t>(error < 0 ? -error : error));
+    }
+    lastTick = started;
+
+    followLeader();
+    followerStatus();
+    publishLinkQuality();
+    tickDuration.record(monotonicMicros() - started);
+}
+
+/**
+ * Dispatches a datagram received on the V2V port to the handler of its type.
+ *
+ * @param data - received datagram
+ * @param sender - "ip:port" of the sending car
+ * @param ts - time the datagram was received
+ */
+void V2VService::receive(std::string_view data, std::string_view sender,
+    const std::chrono::system_clock::time_point &ts)
+{
+    recorder.frame(data, sender, ts);
+    WireFrame frames[MAX_BUNDLED];
+    const size_t count = extract(data, frames, MAX_BUNDLED);
+    for (size_t i = 0; i < count; i++)
+    {
+        const WireFrame &msg = frames[i];
+        if (Dispatch::UNKNOWN == dispatcher.dispatch(*this, msg, Received{sender, ts, msg.format}))
+        {
+            LOG_WARN("[UDP] ¯\\_(ツ)_/¯ ({} from '{}')", msg.id, sender);
+        }
+    }
+}
+
+/**
+ * Takes a car on as follower if there is room, or updates the framing and
+ * status encoding of a known one, and answers with a FollowResponse.
+ */
+void V2VService::followRequestReceived(FollowRequest &followRequest, const Received &received)
+{
+    LOG_INFO("[UDP] received 'FollowRequest' from '{}'!", received.sender);
+
+    // After receiving a FollowRequest,
+    // check first if the requester is already known or there is room for it.
+    const std::string_view followerIp = received.sender.substr(0, received.sender.find(':'));
+    // CompactLeaderStatus only if both sides want it and can agree on its resolution
+    const StatusFormat statusFormat =
+      static_cast<uint8_t>(StatusFormat::COMPACT) == followRequest.statusFormat()
+      && StatusFormat::COMPACT == config.statusFormat && validResolution(statusResolution)
+      ? StatusFormat::COMPACT : StatusFormat::FULL;
+    bool accepted = false;
+    bool added = false;
+    {
+        std::lock_guard<std::mutex> lock(followersMutex);
+        for (Follower &follower : followers)
+        {
+            if (follower.ip == followerIp)
             {
-              readingsIMU imu = cluon::extractMessage<readingsIMU>(std::move(envelope));
-              PEDAL_SPEED = imu.readingSpeed();
-              STEERING_ANGLE = imu.readingSteeringAngle();
-            } break;
-            case PEDAL_POSITION:
+                follower.format = received.format;
+                follower.statusFormat = statusFormat;
+                follower.bundles = 1 == followRequest.bundles();
+                accepted = true;
+            }
+        }
+        if (not accepted && followers.size() < config.maxFollowers)
+        {
+            // Add the requester to the follower table,
+            // answering in the framing the requester speaks.
+            Follower follower;
+            follower.ip = followerIp;
+            follower.format = received.format;
+            follower.statusFormat = statusFormat;
+            follower.bundles = 1 == followRequest.bundles();
+            follower.lastArrival = 0;
+            follower.statusCount = 0;
+            follower.countingSince = monotonicMicros();
+            accepted = peers.address(followerIp, follower.address);
+            if (accepted)
             {
-              opendlv::proxy::PedalPositionReading p =
-                cluon::extractMessage<opendlv::proxy::PedalPositionReading>(std::move(envelope));
-              PEDAL_SPEED = p.percent();
-            } break;
-            case GROUND_STEERING:
+                follower.liveness =
+                  liveness.create([this, ip = follower.ip]()
+                    {
+                      pipeline.post([this, ip]() { followerLost(ip); });
+                    });
+                liveness.schedule(follower.liveness, config.timeDiff);
+                followers.push_back(follower);
+                added = true;
+            }
+        }
+    }
+
+    if (accepted)
+    {
+        followResponse(followerIp);
+
+        // The first LeaderStatus goes out right away, the keep-alive timer takes over
+        if (added)
+        {
+            liveness.schedule(statusTimer, 0);
+            event(V2VEvent::FOLLOWER_JOINED, followerIp);
+        }
+
+        // Transfer message to internal channel for data visualization
+        mirror(followRequest);
+    }
+}
+
+/**
+ * Starts following once the leader answered, in the LeaderStatus encoding it granted.
+ */
+void V2VService::followResponseReceived(FollowResponse &followResponse, const Received &received)
+{
+    LOG_INFO("[UDP] received 'FollowResponse' from '{}'!", received.sender);
+    // Only the leader asked for answers
+    if (leaderIp.empty()
+      || 0 != received.sender.compare(0, received.sender.find(':'), leaderIp)) {return;}
+    leaderFormat = received.format;
+    liveness.schedule(leaderTimer, config.timeDiff);
+
+    // Leaders that do not know CompactLeaderStatus leave the field at 0
+    leaderResolution = StatusResolution{followResponse.sessionStart(),
+      followResponse.speedResolution(), followResponse.steeringResolution()};
+    leaderStatusFormat =
+      static_cast<uint8_t>(StatusFormat::COMPACT) == followResponse.statusFormat()
+      && validResolution(leaderResolution) ? StatusFormat::COMPACT : StatusFormat::FULL;
+    leaderBundles = 1 == followResponse.bundles();
+    event(V2VEvent::FOLLOWING, leaderIp);
+
+    // Transfer message to internal channel for data visualization
+    mirror(followResponse);
+}
+
+/**
+ * Clears either the follower entry or the leader slot, depending on the sender.
+ */
+void V2VService::stopFollowReceived(StopFollow &stopFollow, const Received &received)
+{
+    LOG_INFO("[UDP] received 'StopFollow' from '{}'!", received.sender);
+    const std::string_view senderIp = received.sender.substr(0, received.sender.find(':'));
+
+    // Not a candidate to follow again until it announces itself anew
+    {
+        std::lock_guard<std::mutex> lock(presenceMutex);
+        presence.forget(senderIp);
+    }
+    if (not removeFollower(senderIp) && senderIp == leaderIp) {clearLeader();}
+    neighbourhoodChanged();
+    
+    // Transfer message to internal channel for data visualization
+    mirror(stopFollow);
+}
+
+/**
+ * Restarts the liveness timer of the follower and records its inter-arrival
+ * time. Duplicates and statuses that cannot be placed are dropped, a
+ * follower that lost more than maxLoss of its recent statuses is let go.
+ */
+void V2VService::followerStatusReceived(FollowerStatus &followerStatus, const Received &received)
+{
+    LOG_DEBUG("[UDP] received 'FollowerStatus' from '{}'!", received.sender);
+
+    // Restart the liveness timer of this follower
+    unsigned long len = received.sender.find(':');
+    const uint64_t arrival = monotonicMicros();
+    std::string lostIp;
+    {
+        std::lock_guard<std::mutex> lock(followersMutex);
+        for (Follower &follower : followers)
+        {
+            if (0 == received.sender.compare(0, len, follower.ip))
             {
-              opendlv::proxy::GroundSteeringReading g =
-                cluon::extractMessage<opendlv::proxy::GroundSteeringReading>(std::move(envelope));
-              STEERING_ANGLE = g.steeringAngle();
-            } break;
-            case LEADER_ID:
+                const Arrival order = follower.sequence.arrived(followerStatus.sequence());
+                if (Arrival::DUPLICATE == order || Arrival::STALE == order)
+                {
+                    LOG_DEBUG("[UDP] dropped 'FollowerStatus' {} from '{}'",
+                              followerStatus.sequence(), follower.ip);
+                    return;
+                }
+                liveness.schedule(follower.liveness, config.timeDiff);
+                if (0 != follower.lastArrival && Arrival::REORDERED != order)
+                {
+                    followerInterArrival.record(arrival - follower.lastArrival);
+                }
+                if (Arrival::REORDERED != order) {follower.lastArrival = arrival;}
+                follower.statusCount++;
+                if (lossy(follower.sequence)) {lostIp = follower.ip;}
+            }
+        }
+    }
+    
+    // Transfer message to internal channel for data visualization
+    mirror(followerStatus);
+
+    if (not lostIp.empty())
+    {
+        LOG_WARN("Follower {} lost too many statuses", lostIp);
+        followerLost(lostIp);
+    }
+}
+
+/**
+ * Expands a CompactLeaderStatus with what the FollowResponse agreed on and
+ * handles it as LeaderStatus.
+ */
+void V2VService::compactLeaderStatusReceived(CompactLeaderStatus &compact,
+    const Received &received)
+{
+    // Meaningless without the session and resolutions of the FollowResponse
+    if (StatusFormat::COMPACT != leaderStatusFormat)
+    {
+        LOG_DEBUG("[UDP] 'CompactLeaderStatus' from '{}' was not agreed on", received.sender);
+        return;
+    }
+
+    // The sequence number goes along, leaderStatusReceived() drops late ones
+    LeaderStatus leaderStatus = expandStatus(compact, leaderResolution);
+    leaderStatusReceived(leaderStatus, received);
+}
+
+/**
+ * Dispatches an envelope received on the broadcast channel.
+ */
+void V2VService::receiveBroadcast(cluon::data::Envelope &&envelope)
+{
+    recorder.envelope(envelope);
+    switch (envelope.dataType())
+    {
+        case ANNOUNCE_PRESENCE:
+        {
+            const std::string data = envelope.serializedData();
+            WireReader reader(data.data(), data.length());
+            AnnouncePresence announcePresence;
+            announcePresence.accept(reader);
+            LOG_DEBUG("[OD4] received 'AnnouncePresence' from '{}', GroupID '{}'!",
+                      announcePresence.vehicleIp(), announcePresence.groupId());
+            // Multicast is looped back, a car does not follow itself
+            if (announcePresence.vehicleIp() == config.ip) {break;}
+
+            bool known;
             {
-              LeaderId id = cluon::extractMessage<LeaderId>(std::move(envelope));
-              GROUP_ID = id.groupId();
-            } break;
-            case KILL_SWITCH:
+                std::lock_guard<std::mutex> lock(presenceMutex);
+                const uint64_t now = monotonicMicros();
+                known = presence.find(announcePresence.vehicleIp(), now);
+                presence.update(announcePresence.vehicleIp(), announcePresence.groupId(), now);
+            }
+            if (announcePresence.groupId() == config.announceGroup)
             {
-              // Check when last FollowerStatus was received
-              if (not v2vService->followerIp.empty())
-              {
-                v2vService->stopFollow(v2vService->followerIp);
-              }
-
-              // Check when last LeaderStatus was received
-              if (not v2vService->leaderIp.empty())
-              {
-                v2vService->stopFollow(v2vService->leaderIp);
-              }
-              exit(0);
+                std::lock_guard<std::mutex> lock(announceMutex);
+                announceScheduler.heard();
             }
-            default: break;
-          }
-        });
-
-      /*
-       * Method used to constantly send messages to a thread
-       * AnnouncePresence automatically stops sending when there's an established connection
-       * FollowerStatus/leaderStatus send to a specific IP, if the car is a leader it
-       sends to the followerIP and vice versa
-       * So the UDP connections filter out messages being delivered
-       */
-      auto atFrequency
-      {[&v2vService]() -> bool
+            // A car that was not around may be looking for a leader
+            if (not known) {neighbourhoodChanged();}
+
+            // Transfer message to internal channel for data visualization
+            mirror(announcePresence);
+            break;
+        }
+        default: LOG_WARN("[OD4] Wrong channel dummy! ({})", envelope.dataType());
+    }
+}
+
+/**
+ * Dispatches an envelope received on the internal channel: readings of the
+ * own vehicle and the group to follow. Only one thread may call this, it is
+ * the only writer of the vehicle state.
+ */
+void V2VService::receiveInternal(cluon::data::Envelope &&envelope)
+{
+    recorder.envelope(envelope);
+    switch (envelope.dataType())
+    {
+        case IMU:
+        case PEDAL_POSITION:
+        case GROUND_STEERING: vehicleReading(std::move(envelope)); break;
+        case LEADER_ID:
         {
+            LeaderId id = cluon::extractMessage<LeaderId>(std::move(envelope));
+            const std::string groupId = id.groupId();
+            post([this, groupId]() { leaderGroup = groupId; });
+        } break;
+        default: break;
+    }
+}
 
-          // Check when last FollowerStatus was received
-          if (not v2vService->followerIp.empty() && v2vService->carConnectionLost(FOLLOWER_STATUS))
-          {
-            std::cout << "Follower lost!" << v2vService->presentCars[GROUP_ID] << std::endl;
-            v2vService->stopFollow(v2vService->followerIp);
-          }
+/**
+ * Turns a reading of the own vehicle into a new vehicle state.
+ *
+ * @param envelope - IMU, PEDAL_POSITION or GROUND_STEERING reading
+ */
+void V2VService::vehicleReading(cluon::data::Envelope &&envelope)
+{
+    VehicleState state = ownState.load();
+    switch (envelope.dataType())
+    {
+        case IMU:
+        {
+            readingsIMU imu = cluon::extractMessage<readingsIMU>(std::move(envelope));
+            state.speed = imu.readingSpeed();
+            state.steeringAngle = imu.readingSteeringAngle();
+            state.distanceTraveled = imu.readingDistanceTraveled();
+        } break;
+        case PEDAL_POSITION:
+        {
+            opendlv::proxy::PedalPositionReading p =
+              cluon::extractMessage<opendlv::proxy::PedalPositionReading>(std::move(envelope));
+            state.speed = p.percent();
+        } break;
+        case GROUND_STEERING:
+        {
+            opendlv::proxy::GroundSteeringReading g =
+              cluon::extractMessage<opendlv::proxy::GroundSteeringReading>(std::move(envelope));
+            state.steeringAngle = g.steeringAngle();
+        } break;
+        default: return;
+    }
+    vehicleState(state);
+}
 
-          // Check when last LeaderStatus was received
-          if (not v2vService->leaderIp.empty() && v2vService->carConnectionLost(LEADER_STATUS))
-          {
-            std::cout << "Leader lost!" << v2vService->presentCars[GROUP_ID] << std::endl;
-            v2vService->stopFollow(v2vService->leaderIp);
-          }
-
-          // Constantly send messages
-          v2vService->announcePresence();
-          v2vService->followRequest(v2vService->presentCars[GROUP_ID]);
-          v2vService->followerStatus();
-          v2vService->leaderStatus();
-          return true;
+/**
+ * Publishes a new state of the own vehicle, sent to the followers as
+ * LeaderStatus. Only one thread may call this, it is the only writer.
+ *
+ * @param state - new state, its sample time is set here
+ */
+void V2VService::vehicleState(const VehicleState &state)
+{
+    VehicleState sampled = state;
+    sampled.sampleTime = monotonicMicros();
+    ownState.publish(sampled);
+    vehicleStateChanged();
+}
+
+/**
+ * Handles a LeaderStatus from the leader, received as such or expanded from a
+ * CompactLeaderStatus: sequence, link quality, liveness and playout.
+ * Duplicates are dropped, and so are late statuses when they would be
+ * forwarded as they arrive and undo a newer one. A leader that lost more
+ * than maxLoss of its recent statuses is given up on.
+ *
+ * @param leaderStatus - received status
+ * @param received - sender and arrival time of the datagram
+ */
+void V2VService::leaderStatusReceived(LeaderStatus &leaderStatus, const Received &received)
+{
+    static_cast<void>(received.sender);  // only used when debug logging is compiled in
+    LOG_DEBUG("[UDP] received 'LeaderStatus' from '{}'! Speed '{}'! "
+              "Angle '{}'! Distance '{}'!", received.sender, leaderStatus.speed(),
+              leaderStatus.steeringAngle(), leaderStatus.distanceTraveled());
+    const Arrival order = leaderSequence.arrived(leaderStatus.sequence());
+    if (Arrival::DUPLICATE == order || Arrival::STALE == order)
+    {
+        LOG_DEBUG("[UDP] dropped 'LeaderStatus' {}", leaderStatus.sequence());
+        return;
+    }
+    if (lossy(leaderSequence))
+    {
+        LOG_WARN("Leader {} lost too many statuses", leaderIp);
+        leaderLost();
+        return;
+    }
+
+    // Restart the liveness timer of the leader
+    liveness.schedule(leaderTimer, config.timeDiff);
+
+    // One-way latency, only as exact as the clock sync between both cars
+    const int64_t transit =
+      std::chrono::duration_cast<std::chrono::microseconds>(
+        received.ts.time_since_epoch()).count()
+      - static_cast<int64_t>(leaderStatus.timestamp()) * 1000;
+    leaderLatency.record(transit > 0 ? static_cast<uint64_t>(transit) : 0);
+
+    // Jitter as in RFC 3550: change in transit time, immune to clock offset
+    if (hasLeaderTransit)
+    {
+        const int64_t d = transit - lastLeaderTransit;
+        leaderJitter.record(static_cast<uint64_t>(d < 0 ? -d : d));
+    }
+    lastLeaderTransit = transit;
+    hasLeaderTransit = true;
+
+    // Without a playout delay the status goes to the internal channel as it arrives
+    if (0 == config.playoutDelay)
+    {
+        if (Arrival::REORDERED == order)
+        {
+            LOG_DEBUG("[UDP] dropped late 'LeaderStatus' {}", leaderStatus.sequence());
+            return;
         }
-      };
-      // Send at higher frequency than 125ms to hopefully compensate for the latency
-      internal->timeTrigger(FREQ, atFrequency);
+        forward(leaderStatus);
+        return;
+    }
+    StatusSample sample;
+    sample.timestamp = leaderStatus.timestamp();
+    sample.speed = leaderStatus.speed();
+    sample.steeringAngle = leaderStatus.steeringAngle();
+    sample.distanceTraveled = leaderStatus.distanceTraveled();
+    const uint64_t arrival = static_cast<uint64_t>(
+      std::chrono::duration_cast<std::chrono::milliseconds>(
+        received.ts.time_since_epoch()).count());
+    std::lock_guard<std::mutex> lock(playoutMutex);
+    if (not playoutBuffer.insert(sample, arrival))
+    {
+        LOG_DEBUG("[UDP] dropped stale 'LeaderStatus' {}", leaderStatus.timestamp());
     }
 }
 
 /**
- * Implementation of the V2VService class as declared in V2VService.hpp
+ * Called by the announce timer on the protocol worker: sends AnnouncePresence
+ * if the scheduler says so and arms the timer for its next decision.
  */
-V2VService::V2VService()
+void V2VService::announce()
 {
-    /*
-     * The broadcast field contains a reference to the broadcast channel which is an OD4Session.
-     * This is where AnnouncePresence messages will be received.
-     */
-    broadcast =
-        std::make_shared<cluon::OD4Session>(BROADCAST_CHANNEL,
-          [this](cluon::data::Envelope &&envelope) noexcept
-          {
-              std::cout << "[OD4] ";
-              switch (envelope.dataType())
-              {
-                  case ANNOUNCE_PRESENCE:
-                  {
-                      AnnouncePresence announcePresence =
-                        cluon::extractMessage<AnnouncePresence>(std::move(envelope));
-                      std::cout << "received 'AnnouncePresence' from '"
-                                << announcePresence.vehicleIp() << "', GroupID '"
-                                << announcePresence.groupId() << "'!" << std::endl;
-
-                      presentCars[announcePresence.groupId()] = announcePresence.vehicleIp();
-                      
-                      // Transfer message to internal channel for data visualization
-                      internal->send(announcePresence);
-                      break;
-                  }
-                  default: std::cout << "Wrong channel dummy!" << std::endl;
-              }
-          });
+    bool due;
+    uint32_t wait;
+    {
+        std::lock_guard<std::mutex> lock(announceMutex);
+        const uint64_t now = monotonicMicros();
+        due = announceScheduler.fire(now);
+        wait = announceScheduler.wait(now);
+    }
+    liveness.schedule(announceTimer, wait);
+    if (due) {announcePresence();}
+}
 
-    /*
-     * Each car declares an incoming UDPReceiver for messages directed at them specifically.
-     * This is where messages such as FollowRequest, FollowResponse, StopFollow, etc. are received.
-     */
-    incoming =
-        std::make_shared<cluon::UDPReceiver>("0.0.0.0", DEFAULT_PORT,
-           [this](std::string &&data, std::string &&sender,
-            std::chrono::system_clock::time_point &&ts) noexcept
-           {
-               std::cout << "[UDP] ";
-               std::pair<int16_t, std::string> msg = extract(data);
-
-               switch (msg.first)
-               {
-                   case FOLLOW_REQUEST:
-                   {
-                       FollowRequest followRequest = decode<FollowRequest>(msg.second);
-                       std::cout << "received '" << followRequest.LongName()
-                                 << "' from '" << sender << "'!" << std::endl;
-
-                       // After receiving a FollowRequest,
-                       // check first if there is currently no car already following.
-                       if (followerIp.empty())
-                       {
-                           // If no, add the requester to known follower slot
-                           // and establish a sending channel.
-                           unsigned long len = sender.find(':');
-                           followerIp = sender.substr(0, len);
-
-                           toFollower =
-                            std::make_shared<cluon::UDPSender>(followerIp, DEFAULT_PORT);
-                           followResponse();
-
-                           // Transfer message to internal channel for data visualization
-                           internal->send(followRequest);
-                       }
-                       break;
-                   }
-                   case FOLLOW_RESPONSE:
-                   {
-                       FollowResponse followResponse = decode<FollowResponse>(msg.second);
-                       std::cout << "received '" << followResponse.LongName()
-                                 << "' from '" << sender << "'!" << std::endl;
-
-                       // Transfer message to internal channel for data visualization
-                       internal->send(followResponse);
-                       break;
-                   }
-                   case STOP_FOLLOW:
-                   {
-                       StopFollow stopFollow = decode<StopFollow>(msg.second);
-                       std::cout << "received '" << stopFollow.LongName()
-                                 << "' from '" << sender << "'!" << std::endl;
-                       // remove leader ip from map
-                       presentCars[GROUP_ID] = "";
-                       
-                       // Clear either follower or leader slot, depending on current role.
-                       unsigned long len = sender.find(':');
-                       if (sender.substr(0, len) == followerIp)
-                       {
-                           followerIp = "";
-                           toFollower.reset();
-                       }
-                       else if (sender.substr(0, len) == leaderIp)
-                       {
-                           leaderIp = "";
-                           toLeader.reset();
-                       }
-                       
-                       // Transfer message to internal channel for data visualization
-                       internal->send(stopFollow);
-                       break;
-                   }
-                   case FOLLOWER_STATUS:
-                   {
-                       FollowerStatus followerStatus = decode<FollowerStatus>(msg.second);
-                       std::cout << "received '" << followerStatus.LongName()
-                                 << "' from '" << sender << "'! " << std::endl;
-
-                       // Reset time when last follower status update received
-                       followerFreq = getTime();
-                       
-                       // Transfer message to internal channel for data visualization
-                       internal->send(followerStatus);
-                       break;
-                   }
-                   case LEADER_STATUS:
-                   {
-                       LeaderStatus leaderStatus = decode<LeaderStatus>(msg.second);
-                       std::cout << "received '" << leaderStatus.LongName()
-                        << "' from '" << sender << "'!"
-                        << "' Speed '" << leaderStatus.speed() << "'!"
-                        << "' Angle '" << leaderStatus.steeringAngle() << "'!"
-                        << "' Distance '" << leaderStatus.distanceTraveled() << "'!"
-                        << std::endl;
-                       // Reset time when last leader status update received
-                       leaderFreq = getTime();
-
-                       // Transfer message to internal channel for data visualization
-                       internal->send(leaderStatus);
-                       break;
-                   }
-                   default: std::cout << "¯\\_(ツ)_/¯" << std::endl;
-               }
-           });
+/**
+ * Brings AnnouncePresence back to its shortest interval after a car appeared
+ * or a follower or the leader left, so whoever looks for a leader finds one soon.
+ */
+void V2VService::neighbourhoodChanged()
+{
+    if (not transport) {return;}
+    uint32_t wait;
+    {
+        std::lock_guard<std::mutex> lock(announceMutex);
+        const uint64_t now = monotonicMicros();
+        if (not announceScheduler.reset(now)) {return;}
+        wait = announceScheduler.wait(now);
+    }
+    liveness.schedule(announceTimer, wait);
 }
 
 /**
@@ -263,14 +630,27 @@ V2VService::V2VService()
  */
 void V2VService::announcePresence()
 {
-    if (not followerIp.empty() || not leaderIp.empty()) {return;}
+    // Keep announcing as long as another follower can be taken on
+    {
+        std::lock_guard<std::mutex> lock(followersMutex);
+        if (followers.size() >= config.maxFollowers) {return;}
+    }
     AnnouncePresence announcePresence;
-    announcePresence.vehicleIp(DASH_IP);
-    announcePresence.groupId(DASH_ID);
-    broadcast->send(announcePresence);
+    announcePresence.vehicleIp(config.ip);
+    announcePresence.groupId(config.announceGroup);
+    if (transport)
+    {
+        char payload[MAX_FRAME_SIZE];
+        WireWriter writer(payload, sizeof(payload));
+        announcePresence.accept(writer);
+        cluon::data::Envelope envelope;
+        envelope.dataType(ANNOUNCE_PRESENCE);
+        envelope.serializedData(std::string(payload, writer.size()));
+        if (not writer.overflow()) {transport->broadcast(std::move(envelope));}
+    }
     
     // Send message to internal channel for visualization
-    internal->send(announcePresence);
+    mirror(announcePresence);
 }
 
 /**
@@ -280,40 +660,96 @@ void V2VService::announcePresence()
  *
  * @param vehicleIp - IP of the target for the FollowRequest
  */
-void V2VService::followRequest(std::string vehicleIp)
+void V2VService::followRequest(std::string_view vehicleIp)
 {
-    if (not leaderIp.empty()) {return;}
+    if (not leaderIp.empty() || vehicleIp == config.ip) {return;}
+    // Nothing goes out to a car that cannot be sent to
+    sockaddr_in address;
+    if (not peers.address(vehicleIp, address))
+    {
+        LOG_DEBUG("[UDP] no endpoint for '{}'", vehicleIp);
+        return;
+    }
 
-    // Reset time when last follower status update received
-    followerFreq = getTime();
-    
     leaderIp = vehicleIp;
-    toLeader = std::make_shared<cluon::UDPSender>(leaderIp, DEFAULT_PORT);
+
+    // Give the leader one timeout period to answer before it is considered lost
+    liveness.schedule(leaderTimer, config.timeDiff);
+    hasLeaderTransit = false;
+    leaderSequence.reset();
+    if (config.playoutDelay > 0)
+    {
+        std::lock_guard<std::mutex> lock(playoutMutex);
+        playoutBuffer.reset();
+        playing = true;
+        liveness.schedule(playoutTimer, PLAYOUT_PERIOD);
+    }
+    toLeader.address = address;
+    hasLeaderAddress = true;
+    leaderFormat = config.wireFormat;
+    leaderStatusFormat = StatusFormat::FULL;
+    leaderBundles = false;
     FollowRequest followRequest;
     followRequest.status(1);
-    toLeader->send(encode(followRequest));
+    followRequest.statusFormat(static_cast<uint8_t>(config.statusFormat));
+    followRequest.bundles(1);
+    sendToLeader(followRequest);
+    event(V2VEvent::FOLLOW_REQUESTED, leaderIp);
 
     // Send message to internal channel for visualization
-    internal->send(followRequest);
+    mirror(followRequest);
+}
+
+/**
+ * Sends a FollowRequest to the car of the followed group that announced
+ * itself last, unless this car already follows one. Cars that stopped
+ * announcing for presenceTtl do not count.
+ */
+void V2VService::followLeader()
+{
+    if (not leaderIp.empty()) {return;}
+    {
+        std::lock_guard<std::mutex> lock(presenceMutex);
+        const uint64_t now = monotonicMicros();
+        if (not presence.leader(leaderGroup, now, candidate)) {return;}
+    }
+    followRequest(candidate);
 }
 
 /**
  * This function send a FollowResponse (id = 1003) message and
- * is sent in response to a FollowRequest (id = 1002).
+ * is sent in response to a FollowRequest (id = 1002). It tells the follower
+ * which LeaderStatus encoding it will get, and for CompactLeaderStatus what
+ * the values are relative to.
+ *
+ * @param vehicleIp - IP of the follower that sent the request
  */
-void V2VService::followResponse()
+void V2VService::followResponse(std::string_view vehicleIp)
 {
-    if (followerIp.empty()) {return;}
-    
-    // Reset time when last follower status update received
-    leaderFreq = getTime();
+    if (vehicleIp.empty()) {return;}
 
+    StatusFormat statusFormat = StatusFormat::FULL;
+    {
+        std::lock_guard<std::mutex> lock(followersMutex);
+        for (const Follower &follower : followers)
+        {
+            if (follower.ip == vehicleIp) {statusFormat = follower.statusFormat;}
+        }
+    }
     FollowResponse followResponse;
     followResponse.status(1);
-    toFollower->send(encode(followResponse));
+    followResponse.statusFormat(static_cast<uint8_t>(statusFormat));
+    followResponse.bundles(1);
+    if (StatusFormat::COMPACT == statusFormat)
+    {
+        followResponse.sessionStart(statusResolution.sessionStart);
+        followResponse.speedResolution(statusResolution.speed);
+        followResponse.steeringResolution(statusResolution.steeringAngle);
+    }
+    sendToFollowers(followResponse, vehicleIp);
 
     // Send message to internal channel for visualization
-    internal->send(followResponse);
+    mirror(followResponse);
 }
 
 /**
@@ -323,29 +759,30 @@ void V2VService::followResponse()
  *
  * @param vehicleIp - IP of the target for the request
  */
-void V2VService::stopFollow(std::string vehicleIp)
+void V2VService::stopFollow(std::string_view vehicleIp)
 {
-
-    // remove leader ip
-    presentCars[GROUP_ID] = "";
+    // Not a candidate to follow again until it announces itself anew
+    {
+        std::lock_guard<std::mutex> lock(presenceMutex);
+        presence.forget(vehicleIp);
+    }
     StopFollow stopFollow;
 
-    if (vehicleIp == leaderIp)
+    // Followers first, vehicleIp may be a view on leaderIp, which clearLeader() empties
+    if (not vehicleIp.empty())
     {
       stopFollow.status(1);
-      toLeader->send(encode(stopFollow));
-      leaderIp = "";
-      toLeader.reset();
+      sendToFollowers(stopFollow, vehicleIp);
+      removeFollower(vehicleIp);
     }
-    if (vehicleIp == followerIp)
+    if (vehicleIp == leaderIp)
     {
       stopFollow.status(1);
-      toFollower->send(encode(stopFollow));
-      followerIp = "";
-      toFollower.reset();
+      sendToLeader(stopFollow);
+      clearLeader();
     }
     // Send message to internal channel for visualization
-    internal->send(stopFollow);
+    mirror(stopFollow);
 }
 
 /**
@@ -357,66 +794,397 @@ void V2VService::followerStatus()
   {
     FollowerStatus followerStatus;
     followerStatus.status(1);
-    toLeader->send(encode(followerStatus));
+    followerStatus.sequence(nextSequence(followerSequence));
+    sendToLeader(followerStatus);
 
     // Send message to internal channel for visualization
-    internal->send(followerStatus);
+    mirror(followerStatus);
   }
 }
 
 /**
- * This function sends a LeaderStatus (id = 2001) message on the follower channel.
- *
- * @param speed - current velocity
- * @param steeringAngle - current steering angle
- * @param distanceTraveled - distance traveled since last reading
+ * This function sends a LeaderStatus (id = 2001) message to every follower,
+ * as CompactLeaderStatus (id = 2002) to those that agreed on it.
+ * Each encoding is encoded once and fanned out with a single batched send,
+ * then the keep-alive timer is armed for the next one. Nothing is sent while
+ * nobody follows, the timer is armed again when a follower joins.
  */
 void V2VService::leaderStatus()
 {
-  if (not followerIp.empty())
+  if (not hasFollowers()) {return;}
+
+  const VehicleState state = ownState.load();
+  const uint64_t now = monotonicMicros();
+  LeaderStatus leaderStatus;
+  leaderStatus.timestamp(getTime());
+  leaderStatus.speed(state.speed);
+  leaderStatus.steeringAngle(state.steeringAngle);
+  leaderStatus.distanceTraveled(state.distanceTraveled);
+  leaderStatus.sequence(nextSequence(statusSequence));
+  sendToFollowers(leaderStatus, StatusFormat::FULL);
+  CompactLeaderStatus compact = compactStatus(leaderStatus, leaderStatus.sequence(),
+    statusResolution);
+  sendToFollowers(compact, StatusFormat::COMPACT);
+
+  uint32_t keepAlive;
   {
-    LeaderStatus leaderStatus;
-    leaderStatus.timestamp(getTime());
-    leaderStatus.speed(PEDAL_SPEED);
-    leaderStatus.steeringAngle(STEERING_ANGLE);
-    leaderStatus.distanceTraveled(0);
-    toFollower->send(encode(leaderStatus));
+    std::lock_guard<std::mutex> lock(statusMutex);
+    statusScheduler.sent(state, now);
+    keepAlive = statusScheduler.keepAlive();
+  }
+  liveness.schedule(statusTimer, keepAlive);
+  estimateLoss(now);
 
-    // Send message to internal channel for visualization
-    internal->send(leaderStatus);
+  // Send message to internal channel for visualization
+  mirror(leaderStatus);
+}
+
+/**
+ * Called whenever the vehicle state was published. A change beyond the
+ * thresholds is sent at once, or as soon as MIN_STATUS_INTERVAL has passed
+ * since the last LeaderStatus; smaller changes wait for the keep-alive.
+ */
+void V2VService::vehicleStateChanged()
+{
+  if (not hasFollowers()) {return;}
+
+  const VehicleState state = ownState.load();
+  uint32_t due;
+  {
+    std::lock_guard<std::mutex> lock(statusMutex);
+    if (not statusScheduler.changed(state)) {return;}
+    due = statusScheduler.due(state, monotonicMicros());
+  }
+  if (0 == due) {leaderStatus();}
+  else {liveness.schedule(statusTimer, due);}
+}
+
+/**
+ * Estimates the loss ratio of the worst follower link every LOSS_WINDOW and
+ * hands it to the LeaderStatus scheduler. Numbered FollowerStatus give it
+ * from their sequence window, for unnumbered ones the FollowerStatus
+ * received are held against those expected at the tick frequency.
+ *
+ * @param now - monotonic microseconds
+ */
+void V2VService::estimateLoss(uint64_t now)
+{
+  if (config.frequency <= 0) {return;}
+  {
+    // Statuses go out from the timing wheel and the internal channel's thread,
+    // the other one may have taken a later now already
+    std::lock_guard<std::mutex> lock(statusMutex);
+    if (now < lastLossEstimate + static_cast<uint64_t>(LOSS_WINDOW) * 1000) {return;}
+    lastLossEstimate = now;
   }
+
+  double loss = 0.0;
+  {
+    std::lock_guard<std::mutex> lock(followersMutex);
+    for (Follower &follower : followers)
+    {
+      const double expected = static_cast<double>(now - follower.countingSince) / 1e6 * config.frequency;
+      if (expected < 1.0) {continue;}
+      const double ratio = follower.sequence.tracking() ? follower.sequence.windowLoss()
+        : 1.0 - static_cast<double>(follower.statusCount) / expected;
+      if (ratio > loss) {loss = ratio;}
+      follower.statusCount = 0;
+      follower.countingSince = now;
+    }
+  }
+  std::lock_guard<std::mutex> lock(statusMutex);
+  statusScheduler.lossRatio(loss);
+}
+
+/**
+ * @return true if the peer behind tracker lost more than maxLoss of its
+ *         recent statuses, judged once it numbered MIN_LOSS_SPAN of them
+ */
+bool V2VService::lossy(const SequenceTracker &tracker) const
+{
+  return config.maxLoss > 0.0f && tracker.windowSpan() >= MIN_LOSS_SPAN
+    && tracker.windowLoss() > config.maxLoss;
+}
+
+/**
+ * @return true if at least one car follows this one
+ */
+bool V2VService::hasFollowers()
+{
+  std::lock_guard<std::mutex> lock(followersMutex);
+  return not followers.empty();
+}
+
+/**
+ * @return IPs of all current followers
+ */
+std::vector<std::string> V2VService::followerIps()
+{
+    std::vector<std::string> ips;
+    std::lock_guard<std::mutex> lock(followersMutex);
+    for (const Follower &follower : followers)
+    {
+        ips.push_back(follower.ip);
+    }
+    return ips;
 }
 
 /**
- * This function addresses emergency scenarios where connection to the other car has been lost.
+ * @return sockets opened and datagrams sent by this car, all 0 while offline
+ */
+SendCounters V2VService::sendCounters() const
+{
+    return transport ? transport->counters() : SendCounters();
+}
+
+/**
+ * Removes a car from the follower table and stops its liveness timer.
  *
- * @param timestamp - time of the latest
- * @param requestId - a constant int used to check which status update was received
+ * @param vehicleIp - IP of the follower
+ * @return false if the car was not following
+ */
+bool V2VService::removeFollower(std::string_view vehicleIp)
+{
+    std::unique_lock<std::mutex> lock(followersMutex);
+    for (auto it = followers.begin(); it != followers.end(); ++it)
+    {
+        if (it->ip == vehicleIp)
+        {
+            // Reported before the entry goes, vehicleIp may be a view on it
+            event(V2VEvent::FOLLOWER_LEFT, vehicleIp);
+            liveness.destroy(it->liveness);
+            followers.erase(it);
+            lock.unlock();
+            neighbourhoodChanged();
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+ * Called by the liveness timer of a follower that stopped sending FollowerStatus.
+ *
+ * @param vehicleIp - IP of the follower
+ */
+void V2VService::followerLost(const std::string &vehicleIp)
+{
+    // The follower may have left on its own just before the timer fired
+    {
+        std::lock_guard<std::mutex> lock(followersMutex);
+        bool known = false;
+        for (const Follower &follower : followers)
+        {
+            known = known || follower.ip == vehicleIp;
+        }
+        if (not known) {return;}
+    }
+    LOG_WARN("Follower lost! {}", vehicleIp);
+    stopFollow(vehicleIp);
+}
+
+/**
+ * Forgets the leader and stops everything that runs while following it.
  */
-bool V2VService::carConnectionLost(int requestId)
+void V2VService::clearLeader()
 {
-    double diff = 0.0;
-    if (FOLLOWER_STATUS == requestId)
+    if (not leaderIp.empty())
     {
-      diff = getTime() - followerFreq;
-      std::cout << "Time between FollowStatus: " << diff << "ms" << std::endl;
+        event(V2VEvent::LEADER_LEFT, leaderIp);
+        neighbourhoodChanged();
     }
-    else if (LEADER_STATUS == requestId)
+    leaderIp = "";
+    hasLeaderAddress = false;
+    liveness.cancel(leaderTimer);
+
+    std::lock_guard<std::mutex> lock(playoutMutex);
+    playing = false;
+    liveness.cancel(playoutTimer);
+}
+
+/**
+ * Runs every PLAYOUT_PERIOD while following: sends the leader's state as it
+ * was playoutDelay ago, interpolated or dead-reckoned by the jitter buffer,
+ * to the internal channel as a LeaderStatus.
+ */
+void V2VService::playout()
+{
+    Setpoint setpoint;
+    bool due;
     {
-      diff = getTime() - leaderFreq;
-      std::cout << "Time between LeaderStatus: " << diff << "ms" << std::endl;
+        std::lock_guard<std::mutex> lock(playoutMutex);
+        if (not playing) {return;}
+        liveness.schedule(playoutTimer, PLAYOUT_PERIOD);
+        due = playoutBuffer.playout(getTime(), setpoint);
     }
-    // Ignore the first message
-    if (diff >= 1.524e+12)
+    if (not due) {return;}
+
+    LeaderStatus leaderStatus;
+    leaderStatus.timestamp(setpoint.timestamp);
+    leaderStatus.speed(setpoint.speed);
+    leaderStatus.steeringAngle(setpoint.steeringAngle);
+    leaderStatus.distanceTraveled(setpoint.distanceTraveled);
+    forward(leaderStatus);
+}
+
+/**
+ * Sends the jitter buffer counters, intervals without playout are skipped.
+ */
+void V2VService::publishPlayoutStats()
+{
+    PlayoutCounters counters;
     {
-      return false;
+        std::lock_guard<std::mutex> lock(playoutMutex);
+        counters = playoutBuffer.counters(true);
     }
-    else if (diff >= TIME_DIFF)
+    if (0 == counters.played && 0 == counters.stale) {return;}
+
+    PlayoutStats playoutStats;
+    playoutStats.played(clamp(counters.played));
+    playoutStats.interpolated(clamp(counters.interpolated));
+    playoutStats.extrapolated(clamp(counters.extrapolated));
+    playoutStats.held(clamp(counters.held));
+    playoutStats.stale(clamp(counters.stale));
+    playoutStats.overflow(clamp(counters.overflow));
+    mirror(playoutStats);
+}
+
+/**
+ * Sends how many copies of each message type were posted to and sent by the
+ * mirror stage. These go straight to the sink, through the stage they would
+ * be coalesced with each other.
+ */
+void V2VService::publishMirrorStats()
+{
+    const auto sink = std::atomic_load(&mirrorSink);
+    if (not sink) {return;}
+    MirrorStage::TypeCounters counters[MirrorStage::MAX_TYPES];
+    const size_t types = mirrorStage.counters(counters, MirrorStage::MAX_TYPES, true);
+    char payload[MAX_FRAME_SIZE];
+    const int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    for (size_t i = 0; i < types; i++)
     {
-      return true;
+        if (0 == counters[i].posted) {continue;}
+        MirrorStats mirrorStats;
+        mirrorStats.messageId(static_cast<uint32_t>(counters[i].id));
+        mirrorStats.posted(clamp(counters[i].posted));
+        mirrorStats.sent(clamp(counters[i].sent));
+        WireWriter writer(payload, sizeof(payload));
+        mirrorStats.accept(writer);
+        thread_local std::string encoded;
+        encoded.assign(payload, writer.size());
+        (*sink)(MIRROR_STATS, encoded, now);
     }
+}
 
-    return false;
+/**
+ * Sends the sequence counters of the leader's LeaderStatus and of every
+ * follower's FollowerStatus. Like MirrorStats these go straight to the sink,
+ * the mirror stage would keep only the last peer's.
+ */
+void V2VService::publishSequenceStats()
+{
+    if (not std::atomic_load(&mirrorSink)) {return;}
+    if (not leaderIp.empty())
+    {
+        publishSequenceStats(leaderIp, LEADER_STATUS, leaderSequence.counters(true));
+    }
+    // Kept per thread like the setpoint payloads, it only grows with the followers
+    thread_local std::vector<std::pair<std::string, SequenceCounters>> counters;
+    counters.clear();
+    {
+        std::lock_guard<std::mutex> lock(followersMutex);
+        for (Follower &follower : followers)
+        {
+            counters.emplace_back(follower.ip, follower.sequence.counters(true));
+        }
+    }
+    for (const auto &follower : counters)
+    {
+        publishSequenceStats(follower.first, FOLLOWER_STATUS, follower.second);
+    }
+}
+
+/**
+ * Sends one SequenceStats message, intervals without numbered statuses are skipped.
+ */
+void V2VService::publishSequenceStats(const std::string &vehicleIp, int32_t messageId,
+    const SequenceCounters &counters)
+{
+    if (0 == counters.expected && 0 == counters.stale) {return;}
+
+    SequenceStats sequenceStats;
+    sequenceStats.vehicleIp(vehicleIp);
+    sequenceStats.messageId(static_cast<uint32_t>(messageId));
+    sequenceStats.expected(clamp(counters.expected));
+    sequenceStats.received(clamp(counters.received));
+    sequenceStats.reordered(clamp(counters.reordered));
+    sequenceStats.duplicates(clamp(counters.duplicates));
+    sequenceStats.stale(clamp(counters.stale));
+    char payload[MAX_FRAME_SIZE];
+    WireWriter writer(payload, sizeof(payload));
+    sequenceStats.accept(writer);
+    const auto sink = std::atomic_load(&mirrorSink);
+    if (writer.overflow() || not sink) {return;}
+    const int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    thread_local std::string encoded;
+    encoded.assign(payload, writer.size());
+    (*sink)(SEQUENCE_STATS, encoded, now);
+}
+
+/**
+ * Called by the leader's liveness timer when LeaderStatus stayed away for timeDiff.
+ */
+void V2VService::leaderLost()
+{
+    const std::string vehicleIp = leaderIp;
+    if (vehicleIp.empty()) {return;}
+    LOG_WARN("Leader lost! {}", vehicleIp);
+    stopFollow(vehicleIp);
+}
+
+/**
+ * Sends percentiles of the link quality histograms to the internal channel
+ * once every statsInterval milliseconds and starts new intervals.
+ */
+void V2VService::publishLinkQuality()
+{
+    if (0 == config.statsInterval) {return;}
+    const uint64_t now = monotonicMicros();
+    if (now - lastStatsPublish < static_cast<uint64_t>(config.statsInterval) * 1000) {return;}
+    lastStatsPublish = now;
+
+    publishHistogram(LEADER_STATUS_LATENCY, leaderLatency);
+    publishHistogram(LEADER_STATUS_JITTER, leaderJitter);
+    publishHistogram(FOLLOWER_STATUS_INTERARRIVAL, followerInterArrival);
+    publishHistogram(TICK_PERIOD_ERROR, tickPeriodError);
+    publishHistogram(TICK_DURATION, tickDuration);
+    publishPlayoutStats();
+    publishMirrorStats();
+    publishSequenceStats();
+}
+
+/**
+ * Sends one LinkQuality message, intervals without samples are skipped.
+ *
+ * @param metric - which measurement the histogram holds
+ * @param histogram - histogram to summarize and reset
+ */
+void V2VService::publishHistogram(uint32_t metric, Histogram &histogram)
+{
+    const HistogramSummary summary = histogram.summary(true);
+    if (0 == summary.count) {return;}
+
+    LinkQuality linkQuality;
+    linkQuality.metric(metric);
+    linkQuality.count(clamp(summary.count));
+    linkQuality.p50(clamp(summary.p50));
+    linkQuality.p99(clamp(summary.p99));
+    linkQuality.p999(clamp(summary.p999));
+    linkQuality.max(clamp(summary.max));
+    mirror(linkQuality);
 }
 
 /**
@@ -435,59 +1203,217 @@ uint64_t V2VService::getTime()
 }
 
 /**
- * The extraction function is used to extract the message ID and message data into a pair.
+ * The extraction function is used to split a datagram into message ID and payload.
+ * Both the binary and the legacy hex framing are accepted.
  *
- * @param data - message data to extract header and data from
- * @return pair consisting of the message ID (extracted from the header) and the message data
- */
-std::pair<int16_t, std::string> V2VService::extract(std::string data)
-{
-    if (data.length() < 10) {return std::pair<int16_t, std::string>(-1, "");}
-    int id, len;
-    std::stringstream ssId(data.substr(0, 4));
-    std::stringstream ssLen(data.substr(4, 10));
-    ssId >> std::hex >> id;
-    ssLen >> std::hex >> len;
-    return std::pair<int16_t, std::string> (
-            data.length() -10 == len ? id : -1,
-            data.substr(10, data.length() -10)
-    );
-};
+ * @param datagram - datagram to extract header and payload from
+ * @return frame with the message ID (-1 if malformed), framing used and a view on the payload
+ */
+WireFrame V2VService::extract(std::string_view datagram)
+{
+    return extractWireFrame(datagram.data(), datagram.length());
+}
+
+/**
+ * Splits a datagram into its messages, a WIRE_BUNDLE datagram holds several.
+ *
+ * @param datagram - datagram to extract the messages from
+ * @param frames - receives one frame per message
+ * @param capacity - size of frames, messages beyond it are dropped
+ * @return number of frames, a malformed datagram gives one frame with ID -1
+ */
+size_t V2VService::extract(std::string_view datagram, WireFrame *frames, size_t capacity)
+{
+    return extractWireFrames(datagram.data(), datagram.length(), frames, capacity);
+}
+
+/**
+ * Queues an encoded message for a car that unpacks bundles. Statuses wait up
+ * to bundleDeadline for company, anything else flushes the car's datagram.
+ *
+ * @param to - endpoint of the car
+ * @param id - message ID
+ * @param payload - encoded message without frame header
+ * @param length - payload length
+ */
+void V2VService::bundle(const sockaddr_in &to, int32_t id, const char *payload, size_t length)
+{
+    const bool urgent = LEADER_STATUS != id && COMPACT_LEADER_STATUS != id && FOLLOWER_STATUS != id;
+    if (bundler.add(to, id, payload, length, urgent, monotonicMicros()))
+    {
+        liveness.schedule(bundleTimer, config.bundleDeadline);
+    }
+}
+
+/**
+ * Sends the bundles that waited long enough and rearms for the next one.
+ */
+void V2VService::flushBundles()
+{
+    const uint32_t wait = bundler.flush(monotonicMicros());
+    if (wait > 0) {liveness.schedule(bundleTimer, wait);}
+}
+
+/**
+ * Reports a change in who follows whom, see V2VConfig::onEvent.
+ */
+void V2VService::event(V2VEvent event, std::string_view vehicleIp)
+{
+    if (config.onEvent) {config.onEvent(event, vehicleIp);}
+}
+
+/**
+ * Encodes a message in the leader's framing and sends it to the leader.
+ *
+ * @tparam T - generic message type
+ * @param msg - message to send
+ */
+template <class T>
+void V2VService::sendToLeader(T &msg)
+{
+    if (not transport || not hasLeaderAddress) {return;}
+    char frame[MAX_FRAME_SIZE];
+    if (leaderBundles && config.bundleDeadline > 0)
+    {
+        WireWriter writer(frame, sizeof(frame));
+        visitFields(msg, writer);
+        if (writer.overflow() || writer.size() > 0xFFFF) {return;}
+        bundle(toLeader.address, msg.ID(), frame, writer.size());
+        return;
+    }
+    const size_t length = encode(msg, leaderFormat, frame, sizeof(frame));
+    if (0 == length) {return;}
+    // The whole frame is the payload of a batch of one without header
+    toLeader.header = frame;
+    toLeader.headerLength = 0;
+    transport->send(&toLeader, 1, frame, length);
+}
+
+/**
+ * Encodes a message once and sends it to one or all followers in a single batched send.
+ *
+ * @tparam T - generic message type
+ * @param msg - message to send
+ * @param vehicleIp - IP of the follower to send to, empty for all followers
+ */
+template <class T>
+void V2VService::sendToFollowers(T &msg, std::string_view vehicleIp)
+{
+    fanOut(msg, [&vehicleIp](const Follower &follower)
+      {
+        return vehicleIp.empty() || follower.ip == vehicleIp;
+      });
+}
 
 /**
- * Generic encode function used to encode a message before it is sent.
+ * Encodes a status once and sends it to the followers that agreed on its encoding.
+ *
+ * @tparam T - LeaderStatus or CompactLeaderStatus
+ * @param msg - message to send
+ * @param statusFormat - encoding of msg
+ */
+template <class T>
+void V2VService::sendToFollowers(T &msg, StatusFormat statusFormat)
+{
+    fanOut(msg, [statusFormat](const Follower &follower)
+      {
+        return follower.statusFormat == statusFormat;
+      });
+}
+
+/**
+ * Encodes a message once and sends it in a single batched send.
  *
  * @tparam T - generic message type
- * @param msg - message to encode
- * @return encoded message
+ * @tparam Match - predicate on Follower
+ * @param msg - message to send
+ * @param match - selects the followers to send to
+ */
+template <class T, class Match>
+void V2VService::fanOut(T &msg, Match match)
+{
+    // Only the frame header differs between followers, the payload is shared
+    char payload[MAX_FRAME_SIZE];
+    char hexHeader[HEX_HEADER_SIZE];
+    char binaryHeader[BINARY_HEADER_SIZE];
+
+    thread_local std::vector<BatchTarget> targets;
+    thread_local std::vector<sockaddr_in> bundled;
+    targets.clear();
+    bundled.clear();
+    {
+        std::lock_guard<std::mutex> lock(followersMutex);
+        for (const Follower &follower : followers)
+        {
+            if (not match(follower)) {continue;}
+            if (follower.bundles && config.bundleDeadline > 0)
+            {
+                bundled.push_back(follower.address);
+                continue;
+            }
+            BatchTarget target;
+            target.address = follower.address;
+            if (WireFormat::BINARY == follower.format)
+            {
+                target.header = binaryHeader;
+                target.headerLength = BINARY_HEADER_SIZE;
+            }
+            else
+            {
+                target.header = hexHeader;
+                target.headerLength = HEX_HEADER_SIZE;
+            }
+            targets.push_back(target);
+        }
+    }
+    // Nothing is encoded for an encoding no follower uses
+    if (targets.empty() && bundled.empty()) {return;}
+
+    WireWriter writer(payload, sizeof(payload));
+    visitFields(msg, writer);
+    if (writer.overflow() || writer.size() > 0xFFFF) {return;}
+    for (const sockaddr_in &to : bundled) {bundle(to, msg.ID(), payload, writer.size());}
+    if (targets.empty()) {return;}
+    writeWireHeader(WireFormat::HEX, msg.ID(), writer.size(), hexHeader);
+    writeWireHeader(WireFormat::BINARY, msg.ID(), writer.size(), binaryHeader);
+    if (transport) {transport->send(targets.data(), targets.size(), payload, writer.size());}
+}
+
+/**
+ * Sends a message that drives the car to the internal channel at once, on the
+ * calling thread. Setpoints go around the mirror stage: every one counts, and
+ * they must not share a slot with the car's own LeaderStatus.
+ *
+ * @tparam T - generic message type
+ * @param msg - message to send
  */
 template <class T>
-std::string V2VService::encode(T msg)
+void V2VService::forward(T &msg)
 {
-    cluon::ToProtoVisitor v;
-    msg.accept(v);
-    std::stringstream buff;
-    buff << std::hex << std::setfill('0')
-         << std::setw(4) << msg.ID()
-         << std::setw(6) << v.encodedData().length()
-         << v.encodedData();
-    return buff.str();
+    const auto sink = std::atomic_load(&mirrorSink);
+    if (not sink) {return;}
+    char buffer[MAX_FRAME_SIZE];
+    WireWriter writer(buffer, sizeof(buffer));
+    visitFields(msg, writer);
+    if (writer.overflow()) {return;}
+    // Kept per thread, only the first setpoint of a thread allocates
+    thread_local std::string payload;
+    payload.assign(buffer, writer.size());
+    const int64_t now = std::chrono::duration_cast<std::chrono::microseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count();
+    (*sink)(T::ID(), payload, now);
 }
 
 /**
- * Generic decode function used to decode an incoming message.
+ * Queues a copy of a message for the internal channel, for data visualization.
+ * The mirror stage sends it from its own thread, coalesced with other
+ * messages of the same type.
  *
  * @tparam T - generic message type
- * @param data - encoded message data
- * @return decoded message
+ * @param msg - message to mirror
  */
 template <class T>
-T V2VService::decode(std::string data)
-{
-    std::stringstream buff(data);
-    cluon::FromProtoVisitor v;
-    v.decodeFrom(buff);
-    T tmp = T();
-    tmp.accept(v);
-    return tmp;
+void V2VService::mirror(T &msg)
+{
+    mirrorStage.post(msg);
 }
@@ -1,35 +1,47 @@
 #ifndef V2V_PROTOCOL_DEMO_V2VSERVICE_HPP
 #define V2V_PROTOCOL_DEMO_V2VSERVICE_HPP
 
-#include <iomanip>
 #include <unistd.h>
 #include <sys/time.h>
 #include "cluon/OD4Session.hpp"
-#include "cluon/UDPSender.hpp"
-#include "cluon/UDPReceiver.hpp"
 #include "cluon/Envelope.hpp"
 #include "Messages.hpp"
+#include "MessageFields.hpp"
+#include "WireCodec.hpp"
+#include "VehicleState.hpp"
+#include "BatchSender.hpp"
+#include "AsyncLog.hpp"
+#include "Histogram.hpp"
+#include "RealTime.hpp"
+#include "TimingWheel.hpp"
+#include "PresenceTable.hpp"
+#include "PeerPool.hpp"
+#include "Bundler.hpp"
+#include "StatusScheduler.hpp"
+#include "AnnounceScheduler.hpp"
+#include "JitterBuffer.hpp"
+#include "MirrorStage.hpp"
+#include "ReceivePipeline.hpp"
+#include "CompactStatus.hpp"
+#include "Recorder.hpp"
+#include "Transport.hpp"
+#include "MessageRegistry.hpp"
+#include "SequenceTracker.hpp"
+#include "SharedRing.hpp"
 #include <iostream>
 #include <chrono>
 #include <thread>
+#include <memory>
+#include <mutex>
+#include <string_view>
+#include <utility>
+#include <vector>
 
 
 /********************************************************/
 /** Car constants ***************************************/
 /********************************************************/
 static const std::string DASH_ID  = "1";
-static std::string DASH_IP;
-static float FREQ;
-static int TIME_DIFF;
-std::string GROUP_ID;
-std::shared_ptr<cluon::OD4Session>  internal;
-
-
-/********************************************************/
-/** Message constants ***************************************/
-/********************************************************/
-static float PEDAL_SPEED;
-static float STEERING_ANGLE;
 
 
 /********************************************************/
@@ -43,6 +55,7 @@ static const int FOLLOW_REQUEST 	= 1002;
 static const int FOLLOW_RESPONSE 	= 1003;
 static const int STOP_FOLLOW 		= 1004;
 static const int LEADER_STATUS 		= 2001;
+static const int COMPACT_LEADER_STATUS	= 2002;
 static const int FOLLOWER_STATUS 	= 3001;
 
 
@@ -50,6 +63,9 @@ static const int FOLLOWER_STATUS 	= 3001;
 /** Dash specific communication constants ***************/
 /********************************************************/
 static const int INTERNAL_CHANNEL 	= 122;
+// Shared memory segments carrying the internal channel to and from a dash on the same host
+static const std::string INTERNAL_RING_OUT  = "/v2v-internal-out";
+static const std::string INTERNAL_RING_IN   = "/v2v-internal-in";
 
 static const int PEDAL_POSITION 	= 1041;
 static const int GROUND_STEERING	= 1045;
@@ -57,42 +73,326 @@ static const int ULTRASONIC_FRONT 	= 2201;
 static const int IMU 				= 2202;
 static const int LEADER_ID          = 2204;
 static const int KILL_SWITCH        = 2205;
+static const int LINK_QUALITY       = 2206;
+static const int PLAYOUT_STATS      = 2207;
+static const int MIRROR_STATS       = 2208;
+static const int SEQUENCE_STATS     = 2210;
+
+/** LinkQuality metrics *********************************/
+static const uint32_t LEADER_STATUS_LATENCY         = 1;
+static const uint32_t LEADER_STATUS_JITTER          = 2;
+static const uint32_t FOLLOWER_STATUS_INTERARRIVAL  = 3;
+static const uint32_t TICK_PERIOD_ERROR             = 4;
+static const uint32_t TICK_DURATION                 = 5;
+
+/** Cars tracked from AnnouncePresence at the same time */
+static const size_t MAX_PRESENT_CARS = 256;
+
+/** LeaderStatus scheduling, in milliseconds *************/
+static const uint32_t MIN_STATUS_INTERVAL = 20;
+static const uint32_t LOSS_WINDOW = 2000;
+
+/** Numbered statuses a peer must have sent before its loss can end the link */
+static const uint32_t MIN_LOSS_SPAN = 16;
+
+/** LeaderStatus playout on a follower, in milliseconds */
+static const uint32_t PLAYOUT_PERIOD = 20;
+static const uint32_t MAX_EXTRAPOLATION = 250;
+
+
+/**
+ * Changes in who follows whom, reported to V2VConfig::onEvent.
+ */
+enum class V2VEvent
+{
+    FOLLOW_REQUESTED,   // a FollowRequest went out to a leader that announced itself
+    FOLLOWING,          // the leader answered with a FollowResponse
+    LEADER_LEFT,        // the leader stopped, was lost or was stopped
+    FOLLOWER_JOINED,    // a FollowRequest was accepted
+    FOLLOWER_LEFT       // a follower stopped, was lost or was stopped
+};
+
+
+/**
+ * Configuration of one car, set from the command line. Every instance of
+ * V2VService has its own, so several cars can run in one process.
+ */
+struct V2VConfig
+{
+    std::string ip;                             // IP of this car, announced to the others
+    std::string announceGroup = DASH_ID;        // group announced in AnnouncePresence
+    std::string followGroup = "7";              // group followed until LEADER_ID says otherwise
+    float frequency = 5.0f;                     // Hz of presence, FollowerStatus and statistics
+    uint32_t timeDiff = 1000;                   // milliseconds of silence before a peer is lost
+    float maxLoss = 0.5f;                       // share of recent statuses missing that ends a link, 0 disables
+    WireFormat wireFormat = WireFormat::BINARY; // framing used when initiating contact
+    size_t maxFollowers = 8;
+    uint32_t statsInterval = 5000;              // milliseconds between LinkQuality, 0 disables
+    uint32_t presenceTtl = 2000;                // milliseconds an AnnouncePresence is valid
+    uint32_t announceMaxInterval = 1000;        // milliseconds, keep below 2/3 of presenceTtl
+    uint32_t announceRedundancy = 1;            // own group heard that suppresses an announcement, 0 never
+    float statusSpeedDelta = 0.05f;
+    float statusSteeringDelta = 0.05f;
+    uint32_t statusKeepAlive = 500;             // milliseconds
+    uint32_t playoutDelay = 100;                // milliseconds, 0 forwards LeaderStatus as it arrives
+    uint32_t bundleDeadline = 0;                // milliseconds statuses may wait to share a datagram, 0 never
+    ThreadPolicy timerThreads;                  // protocol worker and timing wheel
+    ThreadPolicy receiveThreads;                // receiver of the V2V port
+    StatusFormat statusFormat = StatusFormat::COMPACT;
+    float speedResolution = 0.001f;
+    float steeringResolution = 0.001f;
+    float mirrorRate = 10.0f;                   // per message type and second, 0 for every one
+    std::vector<std::pair<int32_t, float>> mirrorRates;     // overrides of single types
+    /** Called on the protocol worker, must not block */
+    std::function<void(V2VEvent event, std::string_view vehicleIp)> onEvent;
+};
+
+
+/**
+ * How a datagram on the V2V port arrived, handed to the message handlers.
+ */
+struct Received
+{
+    std::string_view sender;                            // "ip:port" of the sending car
+    const std::chrono::system_clock::time_point &ts;    // time the datagram was received
+    WireFormat format;                                  // framing the sender used
+};
+
+
+/**
+ * A car following this one, together with what is needed to reach it.
+ */
+struct Follower
+{
+    std::string ip;
+    sockaddr_in address;
+    WireFormat format;
+    StatusFormat statusFormat;  // LeaderStatus encoding agreed on in the FollowResponse
+    bool bundles;               // unpacks WIRE_BUNDLE datagrams, said so in its FollowRequest
+    TimingWheel::TimerId liveness;  // expires when FollowerStatus stays away for timeDiff
+    SequenceTracker sequence;   // of its FollowerStatus
+    uint64_t lastArrival;       // monotonic microseconds, 0 before the first FollowerStatus
+    uint32_t statusCount;       // FollowerStatus received since countingSince, for unnumbered ones
+    uint64_t countingSince;     // monotonic microseconds
+};
 
 
 class V2VService {
 public:
-    std::map <std::string, std::string> presentCars;
     std::string leaderIp;
-    std::string followerIp;
 
-    V2VService();
+    /**
+     * @param config - configuration of the car
+     * @param transport - network of the car, without one the instance only runs
+     *                    the protocol logic and sends nothing, e.g. in benchmarks
+     */
+    explicit V2VService(const V2VConfig &config, std::unique_ptr<Transport> transport = nullptr);
+    ~V2VService();
+    V2VService(const V2VService &) = delete;
+    V2VService &operator=(const V2VService &) = delete;
 
+    void post(std::function<void()> task);
+    void execute(std::function<void()> task);
+    bool publishTo(MirrorStage::Sink sink);
+    bool record(const std::string &path);
+
+    void tick();
     void announcePresence();
-    void followRequest(std::string vehicleIp);
-    void followResponse();
-    void stopFollow(std::string vehicleIp);
+    void followRequest(std::string_view vehicleIp);
+    void followLeader();
+    void followResponse(std::string_view vehicleIp);
+    void stopFollow(std::string_view vehicleIp);
     void leaderStatus();
+    void vehicleState(const VehicleState &state);
+    void vehicleStateChanged();
     void followerStatus();
-    bool carConnectionLost(int request);
+    std::vector<std::string> followerIps();
+    SendCounters sendCounters() const;
+    void publishLinkQuality();
+    void receive(std::string_view data, std::string_view sender,
+                 const std::chrono::system_clock::time_point &ts);
+    void receiveBroadcast(cluon::data::Envelope &&envelope);
+    void receiveInternal(cluon::data::Envelope &&envelope);
+
+    static WireFrame extract(std::string_view datagram);
+    static size_t extract(std::string_view datagram, WireFrame *frames, size_t capacity);
+    template <class T>
+    static size_t encode(T &msg, WireFormat format, char *buffer, size_t size);
+    template <class T>
+    static T decode(const WireFrame &frame);
 
 private:
-    time_t leaderFreq;
-    time_t followerFreq;
+    /** Messages received on the V2V port, dispatched to the ...Received handlers */
+    typedef MessageRegistry<V2VService, Received,
+        Message<FOLLOW_REQUEST, FollowRequest>,
+        Message<FOLLOW_RESPONSE, FollowResponse>,
+        Message<STOP_FOLLOW, StopFollow>,
+        Message<LEADER_STATUS, LeaderStatus>,
+        Message<COMPACT_LEADER_STATUS, CompactLeaderStatus>,
+        Message<FOLLOWER_STATUS, FollowerStatus>> Dispatcher;
+
+    const V2VConfig config;
+    Dispatcher dispatcher;
+
+    /** Group of the leader to follow, owned by the protocol worker */
+    std::string leaderGroup;
+
+    /** Own vehicle, written by the internal channel, read by the status timer */
+    SeqLock<VehicleState> ownState;
+
+    /** Copies of protocol messages for the internal channel */
+    MirrorStage mirrorStage;
+    /** Set once by publishTo() while the protocol threads run, accessed atomically only */
+    std::shared_ptr<const MirrorStage::Sink> mirrorSink;
+    Recorder recorder;
+
+    /** Link quality **************************/
+    Histogram leaderLatency;
+    Histogram leaderJitter;
+    Histogram followerInterArrival;
+    Histogram tickPeriodError;
+    Histogram tickDuration;
+    uint64_t lastTick;
+    int64_t lastLeaderTransit;
+    bool hasLeaderTransit;
+    uint64_t lastStatsPublish;
+
+    /** LeaderStatus send policy, guarded by statusMutex */
+    StatusScheduler statusScheduler;
+    std::mutex statusMutex;
+    uint64_t lastLossEstimate;
+
+    /** CompactLeaderStatus towards followers and from the leader */
+    const StatusResolution statusResolution;
+    StatusFormat leaderStatusFormat;
+    StatusResolution leaderResolution;
+
+    /** Sequence numbers of the statuses sent and of the leader's, see SequenceTracker */
+    std::atomic<uint32_t> statusSequence;
+    std::atomic<uint32_t> followerSequence;
+    SequenceTracker leaderSequence;
+
+    /** LeaderStatus playout, guarded by playoutMutex */
+    JitterBuffer playoutBuffer;
+    std::mutex playoutMutex;
+    bool playing;
+
+    /** Endpoints of the cars paired with so far, owned by the protocol worker */
+    PeerPool peers;
 
-    /** OD4 Sessions *****************************/
-    std::shared_ptr<cluon::OD4Session>  broadcast;
+    /** The leader, sent the whole frame as a batch of one */
+    WireFormat leaderFormat;
+    BatchTarget toLeader;
+    bool hasLeaderAddress;
+    bool leaderBundles;         // unpacks WIRE_BUNDLE datagrams, said so in its FollowResponse
 
-    /** UDP Connections **************************/
-    std::shared_ptr<cluon::UDPReceiver> incoming;
-    std::shared_ptr<cluon::UDPSender>   toLeader;
-    std::shared_ptr<cluon::UDPSender>   toFollower;
+    /** Messages waiting to share a datagram with others for the same car */
+    Bundler bundler;
+
+    /** Followers, guarded by followersMutex *****/
+    std::vector<Follower> followers;
+    std::mutex followersMutex;
+
+    /** Cars announcing themselves, guarded by presenceMutex */
+    PresenceTable presence;
+    std::mutex presenceMutex;
+    std::string candidate;
+
+    /** AnnouncePresence send policy, guarded by announceMutex */
+    AnnounceScheduler announceScheduler;
+    std::mutex announceMutex;
+
+    /** Broadcast channel and V2V port, null while offline */
+    std::unique_ptr<Transport> transport;
+
+    /** Receive path, its worker owns leaderIp and the follower table */
+    ReceivePipeline pipeline;
+
+    /** Liveness, declared last so no timer fires into a half-destroyed service */
+    TimingWheel liveness;
+    TimingWheel::TimerId leaderTimer;
+    TimingWheel::TimerId statusTimer;
+    TimingWheel::TimerId playoutTimer;
+    TimingWheel::TimerId announceTimer;
+    TimingWheel::TimerId bundleTimer;
 
     static uint64_t getTime();
-    static std::pair<int16_t, std::string> extract(std::string data);
+    bool hasFollowers();
+    bool removeFollower(std::string_view vehicleIp);
+    void estimateLoss(uint64_t now);
+    void announce();
+    void neighbourhoodChanged();
+    bool lossy(const SequenceTracker &tracker) const;
+    void followerLost(const std::string &vehicleIp);
+    void leaderLost();
+    void followRequestReceived(FollowRequest &followRequest, const Received &received);
+    void followResponseReceived(FollowResponse &followResponse, const Received &received);
+    void stopFollowReceived(StopFollow &stopFollow, const Received &received);
+    void followerStatusReceived(FollowerStatus &followerStatus, const Received &received);
+    void leaderStatusReceived(LeaderStatus &leaderStatus, const Received &received);
+    void compactLeaderStatusReceived(CompactLeaderStatus &compact, const Received &received);
+    void vehicleReading(cluon::data::Envelope &&envelope);
+    void clearLeader();
+    void playout();
+    void publishPlayoutStats();
+    void publishMirrorStats();
+    void publishSequenceStats();
+    void publishSequenceStats(const std::string &vehicleIp, int32_t messageId,
+                              const SequenceCounters &counters);
+    void publishHistogram(uint32_t metric, Histogram &histogram);
+    void event(V2VEvent event, std::string_view vehicleIp);
+    void bundle(const sockaddr_in &to, int32_t id, const char *payload, size_t length);
+    void flushBundles();
     template <class T>
-    static std::string encode(T msg);
+    void sendToLeader(T &msg);
     template <class T>
-    static T decode(std::string data);
+    void sendToFollowers(T &msg, std::string_view vehicleIp);
+    template <class T>
+    void sendToFollowers(T &msg, StatusFormat statusFormat);
+    template <class T, class Match>
+    void fanOut(T &msg, Match match);
+    template <class T>
+    void forward(T &msg);
+    template <class T>
+    void mirror(T &msg);
 };
 
+/**
+ * Generic encode function used to encode a message into a caller-provided buffer.
+ *
+ * @tparam T - generic message type
+ * @param msg - message to encode
+ * @param format - framing to put in front of the payload
+ * @param buffer - destination buffer
+ * @param size - capacity of the destination buffer
+ * @return length of the encoded frame, 0 if it did not fit
+ */
+template <class T>
+size_t V2VService::encode(T &msg, WireFormat format, char *buffer, size_t size)
+{
+    const size_t header = WireFormat::BINARY == format ? BINARY_HEADER_SIZE : HEX_HEADER_SIZE;
+    if (size < header) {return 0;}
+    WireWriter writer(buffer + header, size - header);
+    visitFields(msg, writer);
+    if (writer.overflow() || writer.size() > 0xFFFF) {return 0;}
+    writeWireHeader(format, msg.ID(), writer.size(), buffer);
+    return header + writer.size();
+}
+
+/**
+ * Generic decode function used to decode an incoming message.
+ *
+ * @tparam T - generic message type
+ * @param frame - extracted frame holding the encoded payload
+ * @return decoded message
+ */
+template <class T>
+T V2VService::decode(const WireFrame &frame)
+{
+    WireReader reader(frame.payload, frame.length);
+    T tmp = T();
+    visitFields(tmp, reader);
+    return tmp;
+}
+
 #endif //V2V_PROTOCOL_DEMO_V2VSERVICE_HPP
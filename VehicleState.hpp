@@ -0,0 +1,102 @@
+#ifndef V2V_PROTOCOL_DEMO_VEHICLESTATE_HPP
+#define V2V_PROTOCOL_DEMO_VEHICLESTATE_HPP
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+
+/**
+ * Latest readings of the own vehicle as published by the internal channel.
+ */
+struct VehicleState
+{
+    float speed;
+    float steeringAngle;
+    uint8_t distanceTraveled;
+    uint64_t sampleTime;        // steady_clock microseconds, see monotonicMicros()
+};
+
+/**
+ * @return microseconds on the monotonic clock, unaffected by NTP adjustments
+ */
+inline uint64_t monotonicMicros()
+{
+    using namespace std::chrono;
+    return static_cast<uint64_t>(
+        duration_cast<microseconds>(steady_clock::now().time_since_epoch()).count());
+}
+
+
+/**
+ * Single-writer sequence lock.
+ *
+ * The writer never waits: it bumps the sequence to an odd value, stores the
+ * value and bumps the sequence again. Readers copy the value and retry if the
+ * sequence was odd or changed meanwhile, so they always see one complete
+ * publish. The value is kept in atomic words so concurrent copies are not a
+ * data race.
+ *
+ * @tparam T - trivially copyable value type
+ */
+template <class T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+
+public:
+    SeqLock() noexcept : sequence(0)
+    {
+        for (auto &word : storage) {word.store(0, std::memory_order_relaxed);}
+    }
+
+    /**
+     * Publishes a new value. Must only be called from one thread.
+     */
+    void publish(const T &value) noexcept
+    {
+        uint64_t words[WORDS] = {};
+        std::memcpy(words, &value, sizeof(T));
+
+        const uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        for (size_t i = 0; i < WORDS; i++)
+        {
+            storage[i].store(words[i], std::memory_order_relaxed);
+        }
+        sequence.store(seq + 2, std::memory_order_release);
+    }
+
+    /**
+     * @return consistent snapshot of the last published value
+     */
+    T load() const noexcept
+    {
+        uint64_t words[WORDS];
+        uint32_t before, after;
+        do
+        {
+            before = sequence.load(std::memory_order_acquire);
+            for (size_t i = 0; i < WORDS; i++)
+            {
+                words[i] = storage[i].load(std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+
+        T value;
+        std::memcpy(&value, words, sizeof(T));
+        return value;
+    }
+
+private:
+    static const size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    std::atomic<uint32_t> sequence;
+    std::atomic<uint64_t> storage[WORDS];
+};
+
+#endif //V2V_PROTOCOL_DEMO_VEHICLESTATE_HPP
@@ -0,0 +1,488 @@
+#ifndef V2V_PROTOCOL_DEMO_WIRECODEC_HPP
+#define V2V_PROTOCOL_DEMO_WIRECODEC_HPP
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+
+/********************************************************/
+/** Wire framing constants ******************************/
+/********************************************************/
+/*
+ * Two framings are understood on the V2V port:
+ *
+ *  HEX    (version 0) - 4 ASCII hex digits message ID, 6 ASCII hex digits
+ *                       payload length, payload. Used by cars that have not
+ *                       been upgraded yet.
+ *  BINARY (version 1) - 1 byte magic, 1 byte version, uint16 message ID and
+ *                       uint16 payload length (both little-endian), payload.
+ *
+ * The magic byte is outside of the ASCII range so a receiver can tell both
+ * framings apart from the first byte of a datagram.
+ */
+enum class WireFormat : uint8_t
+{
+    HEX    = 0,
+    BINARY = 1
+};
+
+static const uint8_t WIRE_MAGIC           = 0xB2;
+static const uint8_t WIRE_VERSION         = 1;
+static const size_t  HEX_HEADER_SIZE      = 10;
+static const size_t  BINARY_HEADER_SIZE   = 6;
+static const size_t  MAX_FRAME_SIZE       = 1472;
+
+/**
+ * A binary frame with this ID carries several messages for the same car.
+ * Its payload is a sequence of entries, each a uint16 message ID and a
+ * uint16 payload length (little-endian) followed by the payload.
+ */
+static const int32_t WIRE_BUNDLE          = 1000;
+static const size_t  BUNDLE_ENTRY_SIZE    = 4;
+static const size_t  MAX_BUNDLED          = 64;
+
+
+/**
+ * A received frame. The payload points into the datagram it was extracted
+ * from and is only valid as long as that datagram is.
+ */
+struct WireFrame
+{
+    int16_t id;
+    const char *payload;
+    size_t length;
+    WireFormat format;
+};
+
+
+/**
+ * Protobuf visitor that serializes a message straight into a caller-provided
+ * buffer. Produces the same bytes as cluon::ToProtoVisitor, so payloads stay
+ * interchangeable with cars that still use it.
+ */
+class WireWriter {
+public:
+    WireWriter(char *buffer, size_t capacity) noexcept
+        : buffer(buffer), capacity(capacity), written(0), overflowed(false) {}
+
+    size_t size() const noexcept { return written; }
+    bool overflow() const noexcept { return overflowed; }
+
+    void preVisit(int32_t, const std::string &, const std::string &) noexcept {}
+    void postVisit() noexcept {}
+
+    void visit(uint32_t id, std::string &&, std::string &&, bool &v) noexcept
+    { varintField(id, v ? 1 : 0); }
+    void visit(uint32_t id, std::string &&, std::string &&, char &v) noexcept
+    { varintField(id, static_cast<uint8_t>(v)); }
+    void visit(uint32_t id, std::string &&, std::string &&, uint8_t &v) noexcept
+    { varintField(id, v); }
+    void visit(uint32_t id, std::string &&, std::string &&, uint16_t &v) noexcept
+    { varintField(id, v); }
+    void visit(uint32_t id, std::string &&, std::string &&, uint32_t &v) noexcept
+    { varintField(id, v); }
+    void visit(uint32_t id, std::string &&, std::string &&, uint64_t &v) noexcept
+    { varintField(id, v); }
+    void visit(uint32_t id, std::string &&, std::string &&, int8_t &v) noexcept
+    { varintField(id, zigzag(v)); }
+    void visit(uint32_t id, std::string &&, std::string &&, int16_t &v) noexcept
+    { varintField(id, zigzag(v)); }
+    void visit(uint32_t id, std::string &&, std::string &&, int32_t &v) noexcept
+    { varintField(id, zigzag(v)); }
+    void visit(uint32_t id, std::string &&, std::string &&, int64_t &v) noexcept
+    { varintField(id, zigzag(v)); }
+
+    void visit(uint32_t id, std::string &&, std::string &&, float &v) noexcept
+    {
+        uint32_t raw;
+        std::memcpy(&raw, &v, sizeof(raw));
+        putVarint(key(id, FOUR_BYTES));
+        putFixed(raw, 4);
+    }
+
+    void visit(uint32_t id, std::string &&, std::string &&, double &v) noexcept
+    {
+        uint64_t raw;
+        std::memcpy(&raw, &v, sizeof(raw));
+        putVarint(key(id, EIGHT_BYTES));
+        putFixed(raw, 8);
+    }
+
+    void visit(uint32_t id, std::string &&, std::string &&, std::string &v) noexcept
+    {
+        putVarint(key(id, LENGTH_DELIMITED));
+        putVarint(v.length());
+        putBytes(v.data(), v.length());
+    }
+
+    // Nested messages are not part of the V2V protocol.
+    template <class T>
+    void visit(uint32_t &, std::string &&, std::string &&, T &) noexcept {}
+
+    /**
+     * Writes a length-delimited field from a buffer, e.g. a nested message
+     * encoded by another writer.
+     */
+    void bytes(uint32_t id, const char *data, size_t length) noexcept
+    {
+        putVarint(key(id, LENGTH_DELIMITED));
+        putVarint(length);
+        putBytes(data, length);
+    }
+
+private:
+    enum : uint8_t { VARINT = 0, EIGHT_BYTES = 1, LENGTH_DELIMITED = 2, FOUR_BYTES = 5 };
+
+    char *buffer;
+    size_t capacity;
+    size_t written;
+    bool overflowed;
+
+    static uint64_t key(uint32_t id, uint8_t type) noexcept
+    { return (static_cast<uint64_t>(id) << 3) | type; }
+
+    static uint64_t zigzag(int64_t v) noexcept
+    { return (static_cast<uint64_t>(v) << 1) ^ static_cast<uint64_t>(v >> 63); }
+
+    void varintField(uint32_t id, uint64_t v) noexcept
+    {
+        putVarint(key(id, VARINT));
+        putVarint(v);
+    }
+
+    void putVarint(uint64_t v) noexcept
+    {
+        while (v >= 0x80)
+        {
+            putByte(static_cast<uint8_t>(v | 0x80));
+            v >>= 7;
+        }
+        putByte(static_cast<uint8_t>(v));
+    }
+
+    void putFixed(uint64_t v, size_t bytes) noexcept
+    {
+        for (size_t i = 0; i < bytes; i++)
+        {
+            putByte(static_cast<uint8_t>(v >> (8 * i)));
+        }
+    }
+
+    void putBytes(const char *data, size_t length) noexcept
+    {
+        if (written + length > capacity) {overflowed = true; return;}
+        std::memcpy(buffer + written, data, length);
+        written += length;
+    }
+
+    void putByte(uint8_t b) noexcept
+    {
+        if (written >= capacity) {overflowed = true; return;}
+        buffer[written++] = static_cast<char>(b);
+    }
+};
+
+
+/**
+ * Protobuf visitor that fills a message from a payload without copying it
+ * into a stream first. Fields missing from the payload keep their default.
+ */
+class WireReader {
+public:
+    WireReader(const char *payload, size_t length) noexcept
+        : input(reinterpret_cast<const uint8_t *>(payload)), inputLength(length) {}
+
+    void preVisit(int32_t, const std::string &, const std::string &) noexcept {}
+    void postVisit() noexcept {}
+
+    void visit(uint32_t id, std::string &&, std::string &&, bool &v) noexcept
+    { uint64_t u; if (varintField(id, u)) {v = (0 != u);} }
+    void visit(uint32_t id, std::string &&, std::string &&, char &v) noexcept
+    { uint64_t u; if (varintField(id, u)) {v = static_cast<char>(u);} }
+    void visit(uint32_t id, std::string &&, std::string &&, uint8_t &v) noexcept
+    { uint64_t u; if (varintField(id, u)) {v = static_cast<uint8_t>(u);} }
+    void visit(uint32_t id, std::string &&, std::string &&, uint16_t &v) noexcept
+    { uint64_t u; if (varintField(id, u)) {v = static_cast<uint16_t>(u);} }
+    void visit(uint32_t id, std::string &&, std::string &&, uint32_t &v) noexcept
+    { uint64_t u; if (varintField(id, u)) {v = static_cast<uint32_t>(u);} }
+    void visit(uint32_t id, std::string &&, std::string &&, uint64_t &v) noexcept
+    { uint64_t u; if (varintField(id, u)) {v = u;} }
+    void visit(uint32_t id, std::string &&, std::string &&, int8_t &v) noexcept
+    { uint64_t u; if (varintField(id, u)) {v = static_cast<int8_t>(unzigzag(u));} }
+    void visit(uint32_t id, std::string &&, std::string &&, int16_t &v) noexcept
+    { uint64_t u; if (varintField(id, u)) {v = static_cast<int16_t>(unzigzag(u));} }
+    void visit(uint32_t id, std::string &&, std::string &&, int32_t &v) noexcept
+    { uint64_t u; if (varintField(id, u)) {v = static_cast<int32_t>(unzigzag(u));} }
+    void visit(uint32_t id, std::string &&, std::string &&, int64_t &v) noexcept
+    { uint64_t u; if (varintField(id, u)) {v = unzigzag(u);} }
+
+    void visit(uint32_t id, std::string &&, std::string &&, float &v) noexcept
+    {
+        const uint8_t *p;
+        size_t len;
+        if (find(id, FOUR_BYTES, p, len))
+        {
+            uint32_t raw = static_cast<uint32_t>(fixed(p, 4));
+            std::memcpy(&v, &raw, sizeof(v));
+        }
+    }
+
+    void visit(uint32_t id, std::string &&, std::string &&, double &v) noexcept
+    {
+        const uint8_t *p;
+        size_t len;
+        if (find(id, EIGHT_BYTES, p, len))
+        {
+            uint64_t raw = fixed(p, 8);
+            std::memcpy(&v, &raw, sizeof(v));
+        }
+    }
+
+    void visit(uint32_t id, std::string &&, std::string &&, std::string &v) noexcept
+    {
+        const uint8_t *p;
+        size_t len;
+        if (find(id, LENGTH_DELIMITED, p, len))
+        {
+            v.assign(reinterpret_cast<const char *>(p), len);
+        }
+    }
+
+    template <class T>
+    void visit(uint32_t &, std::string &&, std::string &&, T &) noexcept {}
+
+    /**
+     * Finds a length-delimited field without copying it, e.g. a nested
+     * message to hand to another reader.
+     *
+     * @return false if the field is missing
+     */
+    bool bytes(uint32_t id, const char *&data, size_t &length) const noexcept
+    {
+        const uint8_t *p;
+        if (not find(id, LENGTH_DELIMITED, p, length)) {return false;}
+        data = reinterpret_cast<const char *>(p);
+        return true;
+    }
+
+private:
+    enum : uint8_t { VARINT = 0, EIGHT_BYTES = 1, LENGTH_DELIMITED = 2, FOUR_BYTES = 5 };
+
+    const uint8_t *input;
+    size_t inputLength;
+
+    static int64_t unzigzag(uint64_t u) noexcept
+    { return static_cast<int64_t>(u >> 1) ^ -static_cast<int64_t>(u & 1); }
+
+    static uint64_t fixed(const uint8_t *p, size_t bytes) noexcept
+    {
+        uint64_t v = 0;
+        for (size_t i = 0; i < bytes; i++)
+        {
+            v |= static_cast<uint64_t>(p[i]) << (8 * i);
+        }
+        return v;
+    }
+
+    bool readVarint(size_t &pos, uint64_t &v) const noexcept
+    {
+        v = 0;
+        for (unsigned shift = 0; pos < inputLength && shift < 64; shift += 7)
+        {
+            uint8_t b = input[pos++];
+            v |= static_cast<uint64_t>(b & 0x7F) << shift;
+            if (0 == (b & 0x80)) {return true;}
+        }
+        return false;
+    }
+
+    bool varintField(uint32_t id, uint64_t &v) const noexcept
+    {
+        const uint8_t *p;
+        size_t len;
+        if (not find(id, VARINT, p, len)) {return false;}
+        size_t pos = static_cast<size_t>(p - input);
+        return readVarint(pos, v);
+    }
+
+    /**
+     * Scans the payload for a field. As with cluon::FromProtoVisitor the last
+     * occurrence of a field wins.
+     */
+    bool find(uint32_t id, uint8_t type, const uint8_t *&value, size_t &len) const noexcept
+    {
+        bool found = false;
+        size_t pos = 0;
+        while (pos < inputLength)
+        {
+            uint64_t k;
+            if (not readVarint(pos, k)) {return found;}
+            const size_t start = pos;
+            size_t size = 0;
+            switch (k & 0x7)
+            {
+                case VARINT:
+                {
+                    uint64_t skip;
+                    if (not readVarint(pos, skip)) {return found;}
+                    size = pos - start;
+                    pos = start;
+                } break;
+                case EIGHT_BYTES: size = 8; break;
+                case FOUR_BYTES: size = 4; break;
+                case LENGTH_DELIMITED:
+                {
+                    uint64_t n;
+                    if (not readVarint(pos, n)) {return found;}
+                    size = static_cast<size_t>(n);
+                } break;
+                default: return found;
+            }
+            if (size > inputLength - pos) {return found;}
+            if ((k >> 3) == id && (k & 0x7) == type)
+            {
+                value = input + pos;
+                len = size;
+                found = true;
+            }
+            pos += size;
+        }
+        return found;
+    }
+};
+
+
+/********************************************************/
+/** Frame header ****************************************/
+/********************************************************/
+
+/**
+ * Writes a frame header for the given format in front of a payload.
+ *
+ * @param format - framing to use
+ * @param id - message ID
+ * @param length - payload length
+ * @param buffer - destination, must hold at least the header size of the format
+ * @return number of header bytes written
+ */
+inline size_t writeWireHeader(WireFormat format, int32_t id, size_t length, char *buffer) noexcept
+{
+    if (WireFormat::BINARY == format)
+    {
+        buffer[0] = static_cast<char>(WIRE_MAGIC);
+        buffer[1] = static_cast<char>(WIRE_VERSION);
+        buffer[2] = static_cast<char>(id & 0xFF);
+        buffer[3] = static_cast<char>((id >> 8) & 0xFF);
+        buffer[4] = static_cast<char>(length & 0xFF);
+        buffer[5] = static_cast<char>((length >> 8) & 0xFF);
+        return BINARY_HEADER_SIZE;
+    }
+
+    static const char digits[] = "0123456789abcdef";
+    for (int i = 3; i >= 0; i--, id >>= 4)
+    {
+        buffer[i] = digits[id & 0xF];
+    }
+    for (int i = 9; i >= 4; i--, length >>= 4)
+    {
+        buffer[i] = digits[length & 0xF];
+    }
+    return HEX_HEADER_SIZE;
+}
+
+/**
+ * Parses up to count ASCII hex digits.
+ *
+ * @return parsed value, or -1 if a non hex digit was found
+ */
+inline int32_t parseWireHex(const char *digits, size_t count) noexcept
+{
+    int32_t value = 0;
+    for (size_t i = 0; i < count; i++)
+    {
+        const char c = digits[i];
+        int32_t nibble;
+        if (c >= '0' && c <= '9') {nibble = c - '0';}
+        else if (c >= 'a' && c <= 'f') {nibble = c - 'a' + 10;}
+        else if (c >= 'A' && c <= 'F') {nibble = c - 'A' + 10;}
+        else {return -1;}
+        value = (value << 4) | nibble;
+    }
+    return value;
+}
+
+/**
+ * Splits a datagram into message ID and payload, detecting the framing from
+ * the first byte. Malformed frames get the ID -1.
+ *
+ * @param data - received datagram
+ * @param length - datagram length
+ * @return frame pointing into data
+ */
+inline WireFrame extractWireFrame(const char *data, size_t length) noexcept
+{
+    WireFrame frame = {-1, data, 0, WireFormat::HEX};
+    if (length >= BINARY_HEADER_SIZE && WIRE_MAGIC == static_cast<uint8_t>(data[0]))
+    {
+        frame.format = WireFormat::BINARY;
+        if (WIRE_VERSION != static_cast<uint8_t>(data[1])) {return frame;}
+        const uint8_t *p = reinterpret_cast<const uint8_t *>(data);
+        const size_t len = static_cast<size_t>(p[4] | (p[5] << 8));
+        frame.payload = data + BINARY_HEADER_SIZE;
+        if (length - BINARY_HEADER_SIZE != len) {return frame;}
+        frame.id = static_cast<int16_t>(p[2] | (p[3] << 8));
+        frame.length = len;
+        return frame;
+    }
+
+    if (length < HEX_HEADER_SIZE) {return frame;}
+    const int32_t id = parseWireHex(data, 4);
+    const int32_t len = parseWireHex(data + 4, 6);
+    frame.payload = data + HEX_HEADER_SIZE;
+    if (id < 0 || len < 0 || length - HEX_HEADER_SIZE != static_cast<size_t>(len)) {return frame;}
+    frame.id = static_cast<int16_t>(id);
+    frame.length = static_cast<size_t>(len);
+    return frame;
+}
+
+/**
+ * Splits a datagram into the frames it carries: the messages of a bundle,
+ * or the datagram's single frame.
+ *
+ * @param data - datagram
+ * @param length - length of the datagram
+ * @param frames - receives the frames, views into the datagram
+ * @param capacity - room in frames, further messages of a bundle are dropped
+ * @return number of frames, a malformed datagram gives one with ID -1 and a
+ *         malformed bundle entry ends the bundle
+ */
+inline size_t extractWireFrames(const char *data, size_t length, WireFrame *frames,
+    size_t capacity) noexcept
+{
+    if (0 == capacity) {return 0;}
+    const WireFrame frame = extractWireFrame(data, length);
+    if (WIRE_BUNDLE != frame.id || WireFormat::BINARY != frame.format)
+    {
+        frames[0] = frame;
+        return 1;
+    }
+
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(frame.payload);
+    size_t offset = 0;
+    size_t count = 0;
+    while (count < capacity && offset + BUNDLE_ENTRY_SIZE <= frame.length)
+    {
+        const size_t len = static_cast<size_t>(p[offset + 2] | (p[offset + 3] << 8));
+        if (offset + BUNDLE_ENTRY_SIZE + len > frame.length) {break;}
+        WireFrame &entry = frames[count++];
+        entry.id = static_cast<int16_t>(p[offset] | (p[offset + 1] << 8));
+        entry.payload = frame.payload + offset + BUNDLE_ENTRY_SIZE;
+        entry.length = len;
+        entry.format = WireFormat::BINARY;
+        offset += BUNDLE_ENTRY_SIZE + len;
+    }
+    return count;
+}
+
+#endif //V2V_PROTOCOL_DEMO_WIRECODEC_HPP
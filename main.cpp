@@ -0,0 +1,271 @@
+// Vera requires this "Copyright" notice
+
+#include "V2VService.hpp"
+#include "cluon/Time.hpp"
+#include "RealTime.hpp"
+
+#include <mutex>
+#include <sstream>
+
+int main(int argc, char **argv)
+{
+    // Getting command line arguments
+    auto commandlineArguments = cluon::getCommandlineArguments(argc, argv);
+
+    // In case no IP, time diffrence or frequency is provided do nothing
+    if (commandlineArguments.count("ip") == 0 || commandlineArguments.count("diff") == 0
+      || commandlineArguments.count("freq") == 0)
+    {
+        std::cerr <<
+        "You must specify your car's IP and the desired time to wait between status request"
+        << std::endl;
+        std::cerr << "Example: " << argv[0]
+        << " --ip=192.168.8.1 --diff=2000 --freq=5 [--max-loss=0.5] [--followers=8] [--stats=5000]"
+        << " [--wire=hex|binary] [--ttl=2000] [--announce-max=1000] [--announce-redundancy=1]"
+        << " [--keepalive=500] [--speed-delta=0.05] [--steering-delta=0.05]"
+        << " [--playout-delay=100] [--bundle=0] [--mirror=10] [--mirror-rates=2001:25,1001:1]"
+        << " [--status-format=compact|full] [--speed-resolution=0.001]"
+        << " [--steering-resolution=0.001] [--rec=traffic.rec]"
+        << " [--timer-cpu=1] [--timer-priority=80] [--receive-cpu=2] [--receive-priority=70] [--mlock]"
+        << " [--shm]"
+        << std::endl;
+        return -1;
+    }
+    else
+    {
+      // Parse arguments
+      V2VConfig config;
+      config.ip = commandlineArguments["ip"];
+      config.timeDiff = static_cast<uint32_t>(stoi(commandlineArguments["diff"]));
+      config.frequency = stof(commandlineArguments["freq"]);
+      // Share of a peer's recent LeaderStatus or FollowerStatus lost before it is given up, 0 disables
+      if (commandlineArguments.count("max-loss") != 0)
+      {
+        config.maxLoss = stof(commandlineArguments["max-loss"]);
+      }
+      // Milliseconds between LinkQuality reports on the internal channel, 0 disables them
+      if (commandlineArguments.count("stats") != 0)
+      {
+        config.statsInterval = static_cast<uint32_t>(stoi(commandlineArguments["stats"]));
+      }
+      // Number of cars allowed to follow this one at the same time
+      if (commandlineArguments.count("followers") != 0)
+      {
+        config.maxFollowers = static_cast<size_t>(stoi(commandlineArguments["followers"]));
+      }
+      // Milliseconds after its last AnnouncePresence a car is no longer considered for following
+      if (commandlineArguments.count("ttl") != 0)
+      {
+        config.presenceTtl = static_cast<uint32_t>(stoi(commandlineArguments["ttl"]));
+      }
+      // AnnouncePresence backs off from once per tick to every --announce-max ms while nothing changes,
+      // and is left out when --announce-redundancy cars of the own group were heard instead
+      if (commandlineArguments.count("announce-max") != 0)
+      {
+        config.announceMaxInterval = static_cast<uint32_t>(stoi(commandlineArguments["announce-max"]));
+      }
+      if (commandlineArguments.count("announce-redundancy") != 0)
+      {
+        config.announceRedundancy = static_cast<uint32_t>(stoi(commandlineArguments["announce-redundancy"]));
+      }
+      // LeaderStatus goes out when the state moved this much, and every --keepalive ms otherwise
+      if (commandlineArguments.count("keepalive") != 0)
+      {
+        config.statusKeepAlive = static_cast<uint32_t>(stoi(commandlineArguments["keepalive"]));
+      }
+      if (commandlineArguments.count("speed-delta") != 0)
+      {
+        config.statusSpeedDelta = stof(commandlineArguments["speed-delta"]);
+      }
+      if (commandlineArguments.count("steering-delta") != 0)
+      {
+        config.statusSteeringDelta = stof(commandlineArguments["steering-delta"]);
+      }
+      // Milliseconds a follower plays the leader's state behind, 0 forwards LeaderStatus as it arrives
+      if (commandlineArguments.count("playout-delay") != 0)
+      {
+        config.playoutDelay = static_cast<uint32_t>(stoi(commandlineArguments["playout-delay"]));
+      }
+      // Milliseconds statuses to the same car may wait to share a datagram, 0 sends each at once
+      if (commandlineArguments.count("bundle") != 0)
+      {
+        config.bundleDeadline = static_cast<uint32_t>(stoi(commandlineArguments["bundle"]));
+      }
+      // LeaderStatus encoding asked for as a follower and granted as a leader,
+      // "full" sticks to LeaderStatus with its 64 bit timestamp and floats
+      if (commandlineArguments.count("status-format") != 0
+        && commandlineArguments["status-format"] == "full")
+      {
+        config.statusFormat = StatusFormat::FULL;
+      }
+      // Units of speed and steering angle in CompactLeaderStatus sent as a leader
+      if (commandlineArguments.count("speed-resolution") != 0)
+      {
+        config.speedResolution = stof(commandlineArguments["speed-resolution"]);
+      }
+      if (commandlineArguments.count("steering-resolution") != 0)
+      {
+        config.steeringResolution = stof(commandlineArguments["steering-resolution"]);
+      }
+      // Framing used when initiating contact, cars on the old header need "hex"
+      if (commandlineArguments.count("wire") != 0 && commandlineArguments["wire"] == "hex")
+      {
+        config.wireFormat = WireFormat::HEX;
+      }
+      /*
+       * Copies of protocol messages reach the internal channel through the mirror stage,
+       * at most --mirror times per second and message type (0 for every one),
+       * with --mirror-rates overriding single types as id:rate pairs.
+       */
+      if (commandlineArguments.count("mirror") != 0)
+      {
+        config.mirrorRate = stof(commandlineArguments["mirror"]);
+      }
+      if (commandlineArguments.count("mirror-rates") != 0)
+      {
+        std::stringstream rates(commandlineArguments["mirror-rates"]);
+        std::string rate;
+        while (std::getline(rates, rate, ','))
+        {
+          const size_t colon = rate.find(':');
+          if (colon == std::string::npos) {continue;}
+          config.mirrorRates.emplace_back(stoi(rate.substr(0, colon)),
+            stof(rate.substr(colon + 1)));
+        }
+      }
+      /*
+       * The threads keeping the status cadence, pinned to a CPU and run as SCHED_FIFO:
+       * the timer threads drive and run the tick and fire the timers, the receive thread
+       * reads the V2V port. SCHED_FIFO needs CAP_SYS_NICE.
+       */
+      if (commandlineArguments.count("timer-cpu") != 0)
+      {
+        config.timerThreads.cpu = stoi(commandlineArguments["timer-cpu"]);
+      }
+      if (commandlineArguments.count("timer-priority") != 0)
+      {
+        config.timerThreads.priority = stoi(commandlineArguments["timer-priority"]);
+      }
+      if (commandlineArguments.count("receive-cpu") != 0)
+      {
+        config.receiveThreads.cpu = stoi(commandlineArguments["receive-cpu"]);
+      }
+      if (commandlineArguments.count("receive-priority") != 0)
+      {
+        config.receiveThreads.priority = stoi(commandlineArguments["receive-priority"]);
+      }
+      // Keep every page in memory, so no thread waits for one to come back from disk
+      if (commandlineArguments.count("mlock") != 0 && not lockMemory())
+      {
+        std::cerr << "Cannot lock memory, running without --mlock" << std::endl;
+      }
+      // The sink of the service writes to it from the service's threads, so it outlives the service
+      SharedRing toDash;
+      std::shared_ptr<V2VService> v2vService = std::make_shared<V2VService>(config,
+        std::unique_ptr<Transport>(new UdpTransport(BROADCAST_CHANNEL, DEFAULT_PORT)));
+
+      // Everything received is appended to a cluon .rec file, replay it with V2V.Replay
+      if (commandlineArguments.count("rec") != 0 && not v2vService->record(commandlineArguments["rec"]))
+      {
+        std::cerr << "Cannot record to " << commandlineArguments["rec"] << std::endl;
+        return -1;
+      }
+
+      // Readings from the dash arrive on the OD4 session and, while it writes there, from
+      // shared memory. One at a time, this is the only writer of the vehicle state.
+      std::mutex internalLock;
+      auto onInternal{[&v2vService, &internalLock](cluon::data::Envelope &&envelope)
+        {
+          std::lock_guard<std::mutex> lock(internalLock);
+          const int32_t dataType = envelope.dataType();
+          v2vService->receiveInternal(std::move(envelope));
+          if (KILL_SWITCH == dataType)
+          {
+            v2vService->execute([&v2vService]()
+              {
+                // Release every follower
+                for (const std::string &followerIp : v2vService->followerIps())
+                {
+                  v2vService->stopFollow(followerIp);
+                }
+
+                // Check when last LeaderStatus was received
+                if (not v2vService->leaderIp.empty())
+                {
+                  v2vService->stopFollow(v2vService->leaderIp);
+                }
+              });
+            exit(0);
+          }
+        }
+      };
+
+      // Internal communication OD4 session
+      std::shared_ptr<cluon::OD4Session> internal =
+      std::make_shared<cluon::OD4Session>(INTERNAL_CHANNEL,
+        [&onInternal](cluon::data::Envelope &&envelope) noexcept
+        {
+          onInternal(std::move(envelope));
+        });
+
+      /*
+       * With --shm the internal channel also runs through shared memory, for a dash on the
+       * same host that attaches to INTERNAL_RING_OUT and writes to INTERNAL_RING_IN.
+       * Whatever finds no reader there, or no room, goes through the OD4 session.
+       */
+      // Stopped before onInternal and the service go away, it calls both
+      SharedRing fromDash;
+      if (commandlineArguments.count("shm") != 0
+        && not (toDash.create(INTERNAL_RING_OUT) && fromDash.create(INTERNAL_RING_IN)
+          && fromDash.start([&onInternal](int32_t id, std::string_view payload, int64_t sampleTime)
+            {
+              cluon::data::Envelope envelope;
+              envelope.dataType(id);
+              envelope.serializedData(std::string(payload));
+              envelope.sent(cluon::time::now());
+              envelope.received(envelope.sent());
+              envelope.sampleTimeStamp(cluon::time::fromMicroseconds(sampleTime));
+              onInternal(std::move(envelope));
+            })))
+      {
+        std::cerr << "Cannot set up shared memory, the internal channel runs on OD4 only" << std::endl;
+        toDash.close();
+        fromDash.close();
+      }
+
+      v2vService->publishTo([internal, &toDash](int32_t id, const std::string &payload, int64_t sampleTime)
+        {
+          if (toDash.write(id, payload.data(), payload.size(), sampleTime)) {return;}
+          cluon::data::Envelope envelope;
+          envelope.dataType(id);
+          envelope.serializedData(payload);
+          envelope.sampleTimeStamp(cluon::time::fromMicroseconds(sampleTime));
+          internal->send(std::move(envelope));
+        });
+
+      /*
+       * Method used to constantly send messages to a thread
+       * AnnouncePresence automatically stops sending when there's an established connection
+       * FollowerStatus/leaderStatus send to a specific IP, if the car is a leader it
+       sends to all of its followers and vice versa
+       * So the UDP connections filter out messages being delivered
+       */
+      auto atFrequency
+      {[&v2vService]() -> bool
+        {
+          // The protocol worker runs the tick, it owns leaderIp and the follower table.
+          // Posted rather than waited for, which would allocate a shared task every period.
+          v2vService->post([&v2vService]() { v2vService->tick(); });
+          return true;
+        }
+      };
+      // The time trigger runs on this thread, it is one of the timer threads
+      if (not config.timerThreads.isDefault()
+        && not applyThreadPolicy(pthread_self(), config.timerThreads))
+      {
+        std::cerr << "Cannot set CPU or priority of the timer thread" << std::endl;
+      }
+      // Send at higher frequency than 125ms to hopefully compensate for the latency
+      internal->timeTrigger(config.frequency, atFrequency);
+    }
+}